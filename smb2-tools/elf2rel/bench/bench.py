@@ -0,0 +1,128 @@
+# Benchmarks elf2rel on synthetic inputs from elfgen.py. Every scenario is
+# converted several times with --timings, the per-phase medians and the
+# process wall time are written out as JSON. Given a previous result with
+# --compare, every phase is listed next to its baseline and any that got
+# slower by more than --threshold makes the exit code 1.
+#
+# usage: python bench.py <elf2rel> [--output results.json] [--compare baseline.json]
+#                        [--runs 5] [--jobs 1] [--work-dir bench_work] [--scenario name ...]
+
+import os
+import sys
+import json
+import time
+import argparse
+import statistics
+import subprocess
+
+scenarios = {
+	"small": ["--functions", "16", "--objects", "8"],
+	"typical": ["--functions", "64", "--objects", "32"],
+	"call_heavy": ["--functions", "60", "--objects", "20", "--rel24", "400", "--addr16", "200", "--addr32", "8", "--rel32", "4"],
+	"shuffled": ["--functions", "60", "--objects", "20", "--rel24", "400", "--addr16", "200", "--addr32", "8", "--shuffle-relocations"],
+	"external_heavy": ["--functions", "60", "--objects", "20", "--rel24", "100", "--addr16", "50", "--externals", "2000", "--external-ratio", "0.9", "--map-size", "200000"],
+	"debug_bulk": ["--functions", "60", "--objects", "20", "--rel24", "40", "--debug-bytes", "50000000"],
+}
+
+def generate(name, workDir):
+	elfFilename = os.path.join(workDir, name + ".elf")
+	lstFilename = os.path.join(workDir, name + ".lst")
+	argsFilename = os.path.join(workDir, name + ".args")
+
+	# Only regenerate when the scenario changed
+	args = scenarios[name]
+	if os.path.exists(elfFilename) and os.path.exists(argsFilename):
+		with open(argsFilename) as argsFile:
+			if json.load(argsFile) == args:
+				return elfFilename, lstFilename
+
+	generator = os.path.join(os.path.dirname(os.path.abspath(__file__)), "elfgen.py")
+	subprocess.run([sys.executable, generator, elfFilename, "--symbol-file", lstFilename] + args, check=True)
+	with open(argsFilename, "w") as argsFile:
+		json.dump(args, argsFile)
+	return elfFilename, lstFilename
+
+def runScenario(elf2rel, name, workDir, runs, jobs):
+	elfFilename, lstFilename = generate(name, workDir)
+	relFilename = os.path.join(workDir, name + ".rel")
+	timingsFilename = os.path.join(workDir, name + ".timings.json")
+
+	phaseSamples = {}
+	processSamples = []
+	for run in range(runs):
+		start = time.perf_counter()
+		subprocess.run([elf2rel, elfFilename, "-s", lstFilename, "-o", relFilename, "-j", str(jobs), "--timings", timingsFilename],
+					   check=True, stdout=subprocess.DEVNULL)
+		processSamples.append((time.perf_counter() - start) * 1000.0)
+
+		with open(timingsFilename) as timingsFile:
+			timings = json.load(timingsFile)
+		for phase, milliseconds in timings["phases"].items():
+			phaseSamples.setdefault(phase, []).append(milliseconds)
+		phaseSamples.setdefault("wall", []).append(timings["wall"])
+
+	return {
+		"elf_bytes": os.path.getsize(elfFilename),
+		"rel_bytes": os.path.getsize(relFilename),
+		"phases": {phase: round(statistics.median(samples), 3) for phase, samples in phaseSamples.items()},
+		"process": round(statistics.median(processSamples), 3),
+	}
+
+def compare(results, baseline, threshold, minimumTime):
+	regressions = []
+	for name, result in results["scenarios"].items():
+		baseResult = baseline.get("scenarios", {}).get(name)
+		if baseResult is None:
+			continue
+
+		timings = dict(result["phases"], process=result["process"])
+		baseTimings = dict(baseResult["phases"], process=baseResult["process"])
+		for phase, milliseconds in timings.items():
+			baseMilliseconds = baseTimings.get(phase)
+			# Ignore phases too short to measure reliably
+			if baseMilliseconds is None or max(baseMilliseconds, milliseconds) < minimumTime:
+				continue
+			ratio = milliseconds / max(baseMilliseconds, 0.001)
+			print("%-16s %-22s %10.3f ms -> %10.3f ms  %6.2fx" % (name, phase, baseMilliseconds, milliseconds, ratio))
+			if ratio > threshold:
+				regressions.append("%s/%s" % (name, phase))
+	return regressions
+
+def main():
+	parser = argparse.ArgumentParser(description="Benchmark elf2rel on synthetic ELFs")
+	parser.add_argument("elf2rel", help="elf2rel binary to benchmark")
+	parser.add_argument("--output", help="Write results to this JSON file instead of stdout")
+	parser.add_argument("--compare", help="Previous results to compare against")
+	parser.add_argument("--threshold", type=float, default=1.10, help="Slowdown ratio counted as a regression")
+	parser.add_argument("--min-time", type=float, default=5.0, help="Phases faster than this many milliseconds aren't compared")
+	parser.add_argument("--runs", type=int, default=5, help="Conversions per scenario, the median is reported")
+	parser.add_argument("--jobs", type=int, default=1, help="Passed to elf2rel as --jobs")
+	parser.add_argument("--work-dir", default="bench_work", help="Where generated inputs and outputs are kept")
+	parser.add_argument("--scenario", action="append", choices=sorted(scenarios), help="Only run these scenarios")
+	args = parser.parse_args()
+
+	os.makedirs(args.work_dir, exist_ok=True)
+
+	results = {"runs": args.runs, "jobs": args.jobs, "scenarios": {}}
+	for name in args.scenario or scenarios:
+		results["scenarios"][name] = runScenario(args.elf2rel, name, args.work_dir, args.runs, args.jobs)
+
+	output = json.dumps(results, indent="\t")
+	if args.output:
+		with open(args.output, "w") as outputFile:
+			outputFile.write(output + "\n")
+	else:
+		print(output)
+
+	if args.compare:
+		with open(args.compare) as baselineFile:
+			baseline = json.load(baselineFile)
+		regressions = compare(results, baseline, args.threshold, args.min_time)
+		if regressions:
+			print("Regressions over %.2fx: %s" % (args.threshold, ", ".join(regressions)))
+			return 1
+
+	return 0
+
+if __name__ == "__main__":
+	sys.exit(main())
@@ -0,0 +1,45 @@
+# Converts synthetic inputs from elfgen.py that elf2rel must reject and
+# checks that it exits non-zero for each of them. The exit code is the
+# number of inputs that were accepted.
+#
+# usage: python check.py <elf2rel> [--work-dir check_work]
+
+import os
+import sys
+import argparse
+import subprocess
+
+rejected = {
+	"bss_branch": ["--functions", "4", "--objects", "4", "--bss-branches", "1"],
+	"bss_branch_external": ["--functions", "4", "--objects", "4", "--bss-branches", "1", "--externals", "8", "--external-ratio", "0.5"],
+	"sdata_reference": ["--functions", "4", "--objects", "4", "--sdata-references", "1"],
+}
+
+def main():
+	parser = argparse.ArgumentParser(description="Check that elf2rel rejects broken inputs")
+	parser.add_argument("elf2rel", help="elf2rel binary to check")
+	parser.add_argument("--work-dir", default="check_work", help="Where generated inputs and outputs are kept")
+	args = parser.parse_args()
+
+	os.makedirs(args.work_dir, exist_ok=True)
+	generator = os.path.join(os.path.dirname(os.path.abspath(__file__)), "elfgen.py")
+
+	failures = 0
+	for name, generatorArgs in rejected.items():
+		elfFilename = os.path.join(args.work_dir, name + ".elf")
+		lstFilename = os.path.join(args.work_dir, name + ".lst")
+		relFilename = os.path.join(args.work_dir, name + ".rel")
+		subprocess.run([sys.executable, generator, elfFilename, "--symbol-file", lstFilename] + generatorArgs, check=True)
+
+		result = subprocess.run([args.elf2rel, elfFilename, "-s", lstFilename, "-o", relFilename],
+								stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+		if result.returncode == 0:
+			print("%-24s accepted, expected a failure" % name)
+			failures += 1
+		else:
+			print("%-24s rejected with exit code %d" % (name, result.returncode))
+
+	return failures
+
+if __name__ == "__main__":
+	sys.exit(main())
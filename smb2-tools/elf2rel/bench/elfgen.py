@@ -0,0 +1,332 @@
+# Generates synthetic big-endian PPC relocatable ELFs, shaped like what the
+# rel Makefile links (one section per function and object, .rela.* sections,
+# optional debug bulk), plus a matching symbol map for the external symbols.
+#
+# usage: python elfgen.py <output.elf> [--symbol-file <output.lst>] [options]
+
+import struct
+import random
+import argparse
+
+# ELF constants
+SHT_PROGBITS = 1
+SHT_SYMTAB = 2
+SHT_STRTAB = 3
+SHT_RELA = 4
+SHT_NOBITS = 8
+
+SHF_WRITE = 0x1
+SHF_ALLOC = 0x2
+SHF_EXECINSTR = 0x4
+SHF_MERGE = 0x10
+SHF_STRINGS = 0x20
+SHF_INFO_LINK = 0x40
+
+STB_LOCAL = 0
+STB_GLOBAL = 1
+STT_NOTYPE = 0
+STT_OBJECT = 1
+STT_FUNC = 2
+STT_SECTION = 3
+
+R_PPC_ADDR32 = 1
+R_PPC_ADDR16_LO = 4
+R_PPC_ADDR16_HA = 6
+R_PPC_REL24 = 10
+R_PPC_REL14 = 11
+R_PPC_REL32 = 26
+
+class StringTable:
+	def __init__(self):
+		self.data = bytearray(b"\0")
+		self.offsets = {"": 0}
+
+	def add(self, name):
+		if name not in self.offsets:
+			self.offsets[name] = len(self.data)
+			self.data += name.encode() + b"\0"
+		return self.offsets[name]
+
+class Section:
+	def __init__(self, name, type, flags, align, data=b"", size=None, entsize=0):
+		self.name = name
+		self.type = type
+		self.flags = flags
+		self.align = align
+		self.data = bytearray(data)
+		self.size = size
+		self.entsize = entsize
+		self.link = 0
+		self.info = 0
+		self.index = 0
+		self.relocations = []
+
+	def getSize(self):
+		return self.size if self.size is not None else len(self.data)
+
+def main():
+	parser = argparse.ArgumentParser(description="Generate a synthetic big-endian PPC relocatable ELF for elf2rel")
+	parser.add_argument("output", help="Output ELF filename")
+	parser.add_argument("--symbol-file", help="Output symbol map (.lst) for the external references")
+	parser.add_argument("--seed", type=int, default=1)
+	parser.add_argument("--functions", type=int, default=64, help="Number of .text.* function sections")
+	parser.add_argument("--objects", type=int, default=32, help="Number of .data.*, .rodata.* and .bss.* object sections each")
+	parser.add_argument("--strings", type=int, default=16, help="Number of string literals in .rodata.str1.4")
+	parser.add_argument("--externals", type=int, default=16, help="Number of external symbols referenced")
+	parser.add_argument("--unresolved", type=int, default=0, help="Number of external symbols missing from the symbol map")
+	parser.add_argument("--rel24", type=int, default=4, help="R_PPC_REL24 call sites per function")
+	parser.add_argument("--rel14", type=int, default=0, help="R_PPC_REL14 branches per function")
+	parser.add_argument("--bss-branches", type=int, default=0, help="R_PPC_REL24 call sites into .bss per function, elf2rel must reject these")
+	parser.add_argument("--sdata-references", type=int, default=0, help="R_PPC_ADDR16_HA/LO pairs into .sdata per function, elf2rel must reject these")
+	parser.add_argument("--addr16", type=int, default=2, help="R_PPC_ADDR16_HA/LO pairs per function")
+	parser.add_argument("--addr32", type=int, default=2, help="R_PPC_ADDR32 words per data object")
+	parser.add_argument("--rel32", type=int, default=0, help="R_PPC_REL32 words per rodata object")
+	parser.add_argument("--external-ratio", type=float, default=0.25, help="Fraction of references against external symbols")
+	parser.add_argument("--shuffle-relocations", action="store_true", help="Emit relocation entries out of offset order")
+	parser.add_argument("--debug-bytes", type=int, default=0, help="Bytes of .debug_* section bulk")
+	parser.add_argument("--map-size", type=int, default=0, help="Pad the symbol map with unreferenced symbols up to this many entries")
+	args = parser.parse_args()
+
+	rng = random.Random(args.seed)
+
+	sections = [Section("", 0, 0, 0)]
+	strtab = StringTable()
+	symbols = [(0, 0, 0, 0, 0, 0)] # name, value, size, info, other, shndx
+	globalSymbols = []
+
+	def addSection(section):
+		section.index = len(sections)
+		sections.append(section)
+		symbols.append((0, 0, 0, (STB_LOCAL << 4) | STT_SECTION, 0, section.index))
+		return section
+
+	def addSymbol(name, section, value, size, type):
+		globalSymbols.append((strtab.add(name), value, size, (STB_GLOBAL << 4) | type, 0, section.index if section else 0))
+		return name
+
+	# Function sections
+	functions = []
+	for i in range(args.functions):
+		instructionCount = args.rel24 + args.rel14 + args.bss_branches + args.sdata_references * 2 + args.addr16 * 2 + rng.randint(2, 16)
+		section = addSection(Section(".text.function%d" % i, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 4, bytes(instructionCount * 4)))
+		for j in range(instructionCount):
+			struct.pack_into(">L", section.data, j * 4, 0x60000000) # nop
+		functions.append((addSymbol("function%d" % i, section, 0, instructionCount * 4, STT_FUNC), section))
+
+	# Special functions
+	special = []
+	for name in ["_prolog", "_epilog", "_unresolved"]:
+		section = addSection(Section(".text.%s" % name, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 4, struct.pack(">LL", 0x60000000, 0x4E800020)))
+		special.append((addSymbol(name, section, 0, 8, STT_FUNC), section))
+
+	# Data objects
+	dataObjects = []
+	rodataObjects = []
+	bssObjects = []
+	for i in range(args.objects):
+		align = rng.choice([1, 2, 4, 8, 16, 32])
+		size = max(args.addr32 * 4, rng.randint(1, 64)) if align >= 4 else rng.randint(1, 64)
+		section = addSection(Section(".data.object%d" % i, SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, align, bytes(rng.getrandbits(8) for _ in range(size))))
+		dataObjects.append((addSymbol("object%d" % i, section, 0, size, STT_OBJECT), section))
+
+		align = rng.choice([1, 2, 4, 8])
+		size = max(args.rel32 * 4, rng.randint(1, 64)) if align >= 4 else rng.randint(1, 64)
+		section = addSection(Section(".rodata.constant%d" % i, SHT_PROGBITS, SHF_ALLOC, align, bytes(rng.getrandbits(8) for _ in range(size))))
+		rodataObjects.append((addSymbol("constant%d" % i, section, 0, size, STT_OBJECT), section))
+
+		align = rng.choice([1, 4, 8, 32])
+		size = rng.randint(1, 256)
+		section = addSection(Section(".bss.variable%d" % i, SHT_NOBITS, SHF_ALLOC | SHF_WRITE, align, size=size))
+		bssObjects.append((addSymbol("variable%d" % i, section, 0, size, STT_OBJECT), section))
+
+	# Small data, which has no REL section to go into
+	sdataObjects = []
+	if args.sdata_references:
+		section = addSection(Section(".sdata", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 4, bytes(8)))
+		sdataObjects.append((addSymbol("smallObject", section, 0, 8, STT_OBJECT), section))
+
+	# Mergeable strings and constants
+	mergeable = []
+	if args.strings:
+		stringData = bytearray()
+		stringSection = Section(".rodata.str1.4", SHT_PROGBITS, SHF_ALLOC | SHF_MERGE | SHF_STRINGS, 4, entsize=1)
+		for i in range(args.strings):
+			while len(stringData) % 4:
+				stringData += b"\0"
+			mergeable.append(len(stringData))
+			stringData += ("string %d\n" % rng.randint(0, args.strings // 2)).encode() + b"\0"
+		stringSection.data = stringData
+		addSection(stringSection)
+
+	# Constructors and destructors
+	ctors = addSection(Section(".ctors", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 4, bytes(8)))
+	dtors = addSection(Section(".dtors", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 4, bytes(8)))
+	if functions:
+		ctors.relocations.append((0, functions[0][0], R_PPC_ADDR32, 0))
+		dtors.relocations.append((0, functions[-1][0], R_PPC_ADDR32, 0))
+
+	# External symbols
+	externals = ["external%d" % i for i in range(args.externals)]
+	unresolved = ["unresolved%d" % i for i in range(args.unresolved)]
+	externalNames = externals + unresolved
+	for name in externalNames:
+		globalSymbols.append((strtab.add(name), 0, 0, (STB_GLOBAL << 4) | STT_NOTYPE, 0, 0))
+
+	def pickTarget(candidates):
+		if externalNames and rng.random() < args.external_ratio:
+			return rng.choice(externalNames)
+		return rng.choice(candidates)[0]
+
+	# Code relocations
+	dataCandidates = dataObjects + rodataObjects + bssObjects
+	for name, section in functions:
+		offsets = list(range(0, section.getSize(), 4))
+		rng.shuffle(offsets)
+		for i in range(args.rel24):
+			offset = offsets.pop()
+			struct.pack_into(">L", section.data, offset, 0x48000001) # bl
+			section.relocations.append((offset, pickTarget(functions), R_PPC_REL24, 0))
+		for i in range(args.rel14):
+			offset = offsets.pop()
+			struct.pack_into(">L", section.data, offset, 0x41820000) # beq
+			section.relocations.append((offset, name, R_PPC_REL14, section.getSize() - 4 - offset if offset < section.getSize() - 4 else 0))
+		for i in range(args.bss_branches if bssObjects else 0):
+			offset = offsets.pop()
+			struct.pack_into(">L", section.data, offset, 0x48000001) # bl
+			section.relocations.append((offset, rng.choice(bssObjects)[0], R_PPC_REL24, 0))
+		for i in range(args.sdata_references if sdataObjects else 0):
+			offsetHa = offsets.pop()
+			offsetLo = offsets.pop()
+			target = rng.choice(sdataObjects)[0]
+			struct.pack_into(">L", section.data, offsetHa, 0x3C600000) # lis r3
+			struct.pack_into(">L", section.data, offsetLo, 0x38630000) # addi r3, r3
+			section.relocations.append((offsetHa + 2, target, R_PPC_ADDR16_HA, 0))
+			section.relocations.append((offsetLo + 2, target, R_PPC_ADDR16_LO, 0))
+		for i in range(args.addr16):
+			offsetHa = offsets.pop()
+			offsetLo = offsets.pop()
+			target = pickTarget(dataCandidates) if dataCandidates else pickTarget(functions)
+			struct.pack_into(">L", section.data, offsetHa, 0x3C600000) # lis r3
+			struct.pack_into(">L", section.data, offsetLo, 0x38630000) # addi r3, r3
+			section.relocations.append((offsetHa + 2, target, R_PPC_ADDR16_HA, 0))
+			section.relocations.append((offsetLo + 2, target, R_PPC_ADDR16_LO, 0))
+		for offset in mergeable[:2]:
+			if len(offsets) < 2:
+				break
+			# String reference through the section symbol
+			offsetHa = offsets.pop()
+			offsetLo = offsets.pop()
+			section.relocations.append((offsetHa + 2, ".rodata.str1.4", R_PPC_ADDR16_HA, offset))
+			section.relocations.append((offsetLo + 2, ".rodata.str1.4", R_PPC_ADDR16_LO, offset))
+		mergeable = mergeable[2:] + mergeable[:2]
+
+	# Data relocations
+	for name, section in dataObjects:
+		if section.align < 4:
+			continue
+		for i in range(min(args.addr32, section.getSize() // 4)):
+			section.relocations.append((i * 4, pickTarget(functions + dataObjects), R_PPC_ADDR32, 0))
+	for name, section in rodataObjects:
+		if section.align < 4:
+			continue
+		for i in range(min(args.rel32, section.getSize() // 4)):
+			section.relocations.append((i * 4, pickTarget(functions), R_PPC_REL32, 0))
+
+	# Debug bulk
+	if args.debug_bytes:
+		for name, share in [(".debug_info", 0.5), (".debug_line", 0.2), (".debug_abbrev", 0.1), (".debug_str", 0.2)]:
+			size = int(args.debug_bytes * share)
+			addSection(Section(name, SHT_PROGBITS, 0, 1, bytes(rng.getrandbits(8) for _ in range(size)) if size < 0x10000 else bytes(size)))
+
+	# Symbol table, local symbols first
+	sectionSymbols = {}
+	for index, symbol in enumerate(symbols):
+		if index:
+			sectionSymbols[sections[symbol[5]].name] = index
+	firstGlobal = len(symbols)
+	symbolIndex = {}
+	for symbol in globalSymbols:
+		symbolIndex[strtab.data[symbol[0]:strtab.data.index(b"\0", symbol[0])].decode()] = len(symbols)
+		symbols.append(symbol)
+
+	def lookupSymbol(name):
+		if name in symbolIndex:
+			return symbolIndex[name]
+		return sectionSymbols[name]
+
+	# Relocation sections
+	symtab = Section(".symtab", SHT_SYMTAB, 0, 4, entsize=16)
+	for section in list(sections):
+		if not section.relocations:
+			continue
+		section.relocations.sort(key=lambda rel: rel[0])
+		if args.shuffle_relocations:
+			rng.shuffle(section.relocations)
+		rela = Section(".rela" + section.name, SHT_RELA, SHF_INFO_LINK, 4, entsize=12)
+		for offset, target, type, addend in section.relocations:
+			rela.data += struct.pack(">LLl", offset, (lookupSymbol(target) << 8) | type, addend)
+		rela.info = section.index
+		rela.target = symtab
+		addSection(rela)
+		symbols.pop() # Relocation sections don't get section symbols
+
+	symtab.index = len(sections)
+	sections.append(symtab)
+	strtabSection = Section(".strtab", SHT_STRTAB, 0, 1)
+	strtabSection.index = len(sections)
+	sections.append(strtabSection)
+	shstrtab = Section(".shstrtab", SHT_STRTAB, 0, 1)
+	shstrtab.index = len(sections)
+	sections.append(shstrtab)
+
+	for section in sections:
+		if section.type == SHT_RELA:
+			section.link = symtab.index
+	symtab.link = strtabSection.index
+	symtab.info = firstGlobal
+	for symbol in symbols:
+		symtab.data += struct.pack(">LLLBBH", *symbol)
+	strtabSection.data = strtab.data
+
+	shstrtabData = StringTable()
+	nameOffsets = [shstrtabData.add(section.name) for section in sections]
+	shstrtab.data = shstrtabData.data
+
+	# Layout
+	output = bytearray(52)
+	offsets = [0]
+	for section in sections[1:]:
+		if section.type == SHT_NOBITS:
+			offsets.append(len(output))
+			continue
+		while len(output) % max(section.align, 1):
+			output += b"\0"
+		offsets.append(len(output))
+		output += section.data
+	while len(output) % 4:
+		output += b"\0"
+	sectionHeaderOffset = len(output)
+	for index, section in enumerate(sections):
+		if index == 0:
+			output += bytes(40)
+			continue
+		output += struct.pack(">LLLLLLLLLL", nameOffsets[index], section.type, section.flags, 0, offsets[index],
+							  section.getSize(), section.link, section.info, section.align, section.entsize)
+
+	# ELF header: ELFCLASS32, ELFDATA2MSB, ET_REL, EM_PPC
+	struct.pack_into(">4sBBBBB7sHHLLLLLHHHHHH", output, 0, b"\x7FELF", 1, 2, 1, 0, 0, bytes(7),
+					 1, 20, 1, 0, 0, sectionHeaderOffset, 0, 52, 0, 0, 40, len(sections), shstrtab.index)
+
+	with open(args.output, "wb") as outputFile:
+		outputFile.write(output)
+
+	if args.symbol_file:
+		with open(args.symbol_file, "w") as symbolFile:
+			symbolFile.write("// Synthetic symbols\n")
+			for i, name in enumerate(externals):
+				symbolFile.write("%08X:%s\n" % (0x80003000 + i * 0x40, name))
+			for i in range(args.map_size - len(externals)):
+				symbolFile.write("%08X:filler_%d_%08x\n" % (0x80100000 + i * 4, i, rng.getrandbits(32)))
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,96 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// Streaming 64 bit hash for detecting changed inputs. Data is consumed eight
+// bytes at a time with the XXH64 round function, so hashing the sections of
+// a large ELF costs far less than converting it. Not meant to resist
+// deliberate collisions.
+class ContentHash
+{
+public:
+	void update(const void *data, size_t size)
+	{
+		const uint8_t *bytes = static_cast<const uint8_t *>(data);
+		mLength += size;
+
+		// Top up a partial word from the previous call first
+		while (mPendingSize != 0 && size != 0)
+		{
+			mPending[mPendingSize++] = *bytes++;
+			--size;
+			if (mPendingSize == sizeof(mPending))
+			{
+				consume(mPending);
+				mPendingSize = 0;
+			}
+		}
+
+		for (; size >= sizeof(uint64_t); bytes += sizeof(uint64_t), size -= sizeof(uint64_t))
+		{
+			consume(bytes);
+		}
+
+		std::memcpy(mPending + mPendingSize, bytes, size);
+		mPendingSize += size;
+	}
+
+	void update(std::string_view string)
+	{
+		// Length first so that consecutive strings can't run into each other
+		updateValue<uint64_t>(string.size());
+		update(string.data(), string.size());
+	}
+
+	template<typename T>
+	void updateValue(T value)
+	{
+		update(&value, sizeof(value));
+	}
+
+	uint64_t finish() const
+	{
+		uint64_t hash = mState ^ mLength;
+		for (size_t i = 0; i < mPendingSize; ++i)
+		{
+			hash = rotateLeft(hash ^ (mPending[i] * cPrime5), 11) * cPrime1;
+		}
+
+		hash ^= hash >> 33;
+		hash *= cPrime2;
+		hash ^= hash >> 29;
+		hash *= cPrime3;
+		hash ^= hash >> 32;
+		return hash;
+	}
+
+private:
+	static constexpr uint64_t cPrime1 = 0x9E3779B185EBCA87ull;
+	static constexpr uint64_t cPrime2 = 0xC2B2AE3D27D4EB4Full;
+	static constexpr uint64_t cPrime3 = 0x165667B19E3779F9ull;
+	static constexpr uint64_t cPrime4 = 0x85EBCA77C2B2AE63ull;
+	static constexpr uint64_t cPrime5 = 0x27D4EB2F165667C5ull;
+
+	static uint64_t rotateLeft(uint64_t value, int count)
+	{
+		return (value << count) | (value >> (64 - count));
+	}
+
+	void consume(const uint8_t *bytes)
+	{
+		uint64_t word;
+		std::memcpy(&word, bytes, sizeof(word));
+		uint64_t round = rotateLeft(word * cPrime2, 31) * cPrime1;
+		mState = rotateLeft(mState ^ round, 27) * cPrime1 + cPrime4;
+	}
+
+	uint64_t mState = cPrime5;
+	uint64_t mLength = 0;
+	uint8_t mPending[8];
+	size_t mPendingSize = 0;
+};
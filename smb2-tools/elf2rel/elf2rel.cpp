@@ -2,46 +2,167 @@
 // Copyright 2019 Linus S. (aka PistonMiner)
 
 #include "elf2rel.h"
+#include "contenthash.h"
+#include "phasetimer.h"
+#include "symboldb.h"
+#include "symbolmap.h"
+#include "symbolindex.h"
+#include "threadpool.h"
 
 #include <elfio/elfio.hpp>
 
 #include <boost/program_options.hpp>
 #include <boost/algorithm/string.hpp>
 
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
 #include <iostream>
+#include <iterator>
+#include <filesystem>
 #include <fstream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string_view>
+#include <thread>
 #include <tuple>
-#include <deque>
 
-std::map<std::string, uint32_t> loadSymbolMap(const std::string &filename)
+void appendFormat(std::string &output, const char *format, ...)
 {
-	std::map<std::string, uint32_t> outputMap;
+	char buffer[512];
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
 
-	std::ifstream inputStream(filename);
-	for (std::string line; std::getline(inputStream, line); )
+	if (length > 0)
 	{
-		boost::trim_left(line);
+		output.append(buffer, std::min(static_cast<size_t>(length), sizeof(buffer) - 1));
+	}
+}
 
-		// Ignore comments
-		if (line.size() == 0 || line.find_first_of("//") == 0)
+// External symbols a conversion resolves against, either a parsed .lst or
+// one region of a symbol database, and the symbol maps of game RELs the
+// REL imports from
+struct ExternalSymbols
+{
+	const SymbolMap *map = nullptr;
+	const SymbolDatabase *database = nullptr;
+	int region = SymbolDatabase::cInvalidRegion;
+	std::vector<std::pair<uint32_t, const SymbolMap *>> modules;
+
+	bool find(std::string_view name, uint32_t &address) const
+	{
+		if (database)
 		{
-			continue;
+			return database->find(region, name, address);
+		}
+
+		return map->find(name, address);
+	}
+
+	// Looks a symbol up in the game RELs, in the order their maps were given
+	bool findInModule(std::string_view name, uint32_t &moduleID, uint32_t &section, uint32_t &offset) const
+	{
+		for (const auto &module : modules)
+		{
+			if (module.second->find(name, offset, section))
+			{
+				moduleID = module.first;
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+// Opens the symbol database, rebuilding it first if it is missing, lacks
+// one of the given symbol files or one of its symbol files changed. A
+// rebuild keeps every region of the old database whose .lst still exists.
+bool loadSymbolDatabase(SymbolDatabase &database, const std::string &filename, const std::vector<std::string> &lstFilenames)
+{
+	std::vector<std::string> sources;
+	bool isCurrent = database.open(filename);
+	for (const auto &lstFilename : lstFilenames)
+	{
+		sources.emplace_back(SymbolDatabase::normalizePath(lstFilename));
+		if (isCurrent && database.findRegion(sources.back()) == SymbolDatabase::cInvalidRegion)
+		{
+			isCurrent = false;
+		}
+	}
+	for (int i = 0; i < database.getRegionCount() && isCurrent; ++i)
+	{
+		isCurrent = database.isRegionCurrent(i);
+	}
+	if (isCurrent)
+	{
+		return true;
+	}
+
+	SymbolDatabase::SourceInfo info;
+	for (int i = 0; i < database.getRegionCount(); ++i)
+	{
+		std::string source(database.getRegionSource(i));
+		if (SymbolDatabase::getSourceInfo(source, info))
+		{
+			sources.emplace_back(source);
 		}
+	}
+	database.close();
 
-		size_t index = line.find_first_of(':');
+	std::sort(sources.begin(), sources.end());
+	sources.erase(std::unique(sources.begin(), sources.end()), sources.end());
+
+	SymbolDatabase::Builder builder;
+	for (const auto &source : sources)
+	{
+		if (!SymbolDatabase::getSourceInfo(source, info))
+		{
+			printf("Failed to read symbol file '%s'\n", source.c_str());
+			return false;
+		}
 
-		std::string name = line.substr(index + 1);
-		boost::trim_left(name);
+		SymbolMap symbolMap;
+		std::string log;
+		symbolMap.load(source, log);
+		fputs(log.c_str(), stdout);
 
-		uint32_t addr = strtoul(line.substr(0, index).c_str(), nullptr, 16);
+		SymbolDatabase::SymbolList symbols;
+		symbols.reserve(symbolMap.size());
+		for (uint32_t i = 0; i < symbolMap.size(); ++i)
+		{
+			symbols.emplace_back(std::string(symbolMap.getName(i)), symbolMap.getAddress(i));
+		}
+		builder.addRegion(info, symbols);
+	}
 
-		outputMap[name] = addr;
+	std::string log;
+	bool written = builder.write(filename, log);
+	fputs(log.c_str(), stdout);
+	if (!written || !database.open(filename))
+	{
+		printf("Failed to write symbol database '%s'\n", filename.c_str());
+		return false;
 	}
+	return true;
+}
 
-	return outputMap;
+int getModuleHeaderSize(int version)
+{
+	if (version >= 3)
+	{
+		return 0x4C;
+	}
+	else if (version >= 2)
+	{
+		return 0x48;
+	}
+	return 0x40;
 }
 
-void writeModuleHeader(std::vector<uint8_t> &buffer,
+void writeModuleHeader(RelWriter &writer,
 					   int version,
 					   int id,
 					   int sectionCount,
@@ -60,74 +181,2559 @@ void writeModuleHeader(std::vector<uint8_t> &buffer,
 					   int maxBssAlign,
 					   int fixedDataSize)
 {
-	save<uint32_t>(buffer, id);
-	save<uint32_t>(buffer, 0); // prev link
-	save<uint32_t>(buffer, 0); // next link
-	save<uint32_t>(buffer, sectionCount);
-	save<uint32_t>(buffer, sectionInfoOffset);
-	save<uint32_t>(buffer, 0); // name offset
-	save<uint32_t>(buffer, 0); // name size
-	save<uint32_t>(buffer, version); // version
-
-	save<uint32_t>(buffer, totalBssSize);
-	save<uint32_t>(buffer, relocationOffset);
-	save<uint32_t>(buffer, importInfoOffset);
-	save<uint32_t>(buffer, importInfoSize);
-	save<uint8_t>(buffer, prologSection);
-	save<uint8_t>(buffer, epilogSection);
-	save<uint8_t>(buffer, unresolvedSection);
-	save<uint8_t>(buffer, 0); // pad
-	save<uint32_t>(buffer, prologOffset);
-	save<uint32_t>(buffer, epilogOffset);
-	save<uint32_t>(buffer, unresolvedOffset);
+	// The header always lives at the start of the image
+	writer.patchAt<uint32_t>(0x00, id);
+	writer.patchAt<uint32_t>(0x04, 0); // prev link
+	writer.patchAt<uint32_t>(0x08, 0); // next link
+	writer.patchAt<uint32_t>(0x0C, sectionCount);
+	writer.patchAt<uint32_t>(0x10, sectionInfoOffset);
+	writer.patchAt<uint32_t>(0x14, 0); // name offset
+	writer.patchAt<uint32_t>(0x18, 0); // name size
+	writer.patchAt<uint32_t>(0x1C, version); // version
+
+	writer.patchAt<uint32_t>(0x20, totalBssSize);
+	writer.patchAt<uint32_t>(0x24, relocationOffset);
+	writer.patchAt<uint32_t>(0x28, importInfoOffset);
+	writer.patchAt<uint32_t>(0x2C, importInfoSize);
+	writer.patchAt<uint8_t>(0x30, prologSection);
+	writer.patchAt<uint8_t>(0x31, epilogSection);
+	writer.patchAt<uint8_t>(0x32, unresolvedSection);
+	writer.patchAt<uint8_t>(0x33, 0); // pad
+	writer.patchAt<uint32_t>(0x34, prologOffset);
+	writer.patchAt<uint32_t>(0x38, epilogOffset);
+	writer.patchAt<uint32_t>(0x3C, unresolvedOffset);
 	if (version >= 2)
 	{
-		save<uint32_t>(buffer, maxAlign);
-		save<uint32_t>(buffer, maxBssAlign);
+		writer.patchAt<uint32_t>(0x40, maxAlign);
+		writer.patchAt<uint32_t>(0x44, maxBssAlign);
+	}
+	if (version >= 3)
+	{
+		writer.patchAt<uint32_t>(0x48, fixedDataSize);
+	}
+}
+
+void writeSectionInfo(RelWriter &writer, int tableOffset, int index, int offset, int size)
+{
+	writer.patchAt<uint32_t>(tableOffset + index * 8, offset);
+	writer.patchAt<uint32_t>(tableOffset + index * 8 + 4, size);
+}
+
+void writeImportInfo(RelWriter &writer, int tableOffset, int index, int id, int offset)
+{
+	writer.patchAt<uint32_t>(tableOffset + index * 8, id);
+	writer.patchAt<uint32_t>(tableOffset + index * 8 + 4, offset);
+}
+
+void writeRelocation(RelWriter &writer, int offset, int type, int section, uint32_t addend)
+{
+	writer.put<uint16_t>(offset);
+	writer.put<uint8_t>(type);
+	writer.put<uint8_t>(section);
+	writer.put<uint32_t>(addend);
+}
+
+// Applies an absolute relocation the way OSLink would. Returns false for
+// types that depend on where the REL ends up.
+bool applyAbsoluteRelocation(RelWriter &writer, int offset, int type, uint32_t value)
+{
+	switch (type)
+	{
+	case R_PPC_ADDR32:
+		writer.patchAt<uint32_t>(offset, value);
+		return true;
+	case R_PPC_ADDR24:
+		writer.patchAt<uint32_t>(offset, (writer.readAt<uint32_t>(offset) & ~0x03FFFFFC) | (value & 0x03FFFFFC));
+		return true;
+	case R_PPC_ADDR16:
+	case R_PPC_ADDR16_LO:
+		writer.patchAt<uint16_t>(offset, value & 0xFFFF);
+		return true;
+	case R_PPC_ADDR16_HI:
+		writer.patchAt<uint16_t>(offset, value >> 16);
+		return true;
+	case R_PPC_ADDR16_HA:
+		writer.patchAt<uint16_t>(offset, (value >> 16) + ((value & 0x8000) ? 1 : 0));
+		return true;
+	case R_PPC_ADDR14:
+	case R_PPC_ADDR14_BRTAKEN:
+	case R_PPC_ADDR14_BRNKTAKEN:
+		writer.patchAt<uint32_t>(offset, (writer.readAt<uint32_t>(offset) & ~0xFFFC) | (value & 0xFFFC));
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Applies a relocation relative to the patched address the way OSLink would.
+// The conditional branch variants also set the prediction bit of the
+// branch the way the ABI asks for.
+bool applyRelativeRelocation(RelWriter &writer, int offset, int type, uint32_t value, uint32_t address)
+{
+	uint32_t delta = value - address;
+	switch (type)
+	{
+	case R_PPC_REL24:
+		writer.patchAt<uint32_t>(offset, (writer.readAt<uint32_t>(offset) & ~0x03FFFFFC) | (delta & 0x03FFFFFC));
+		return true;
+	case R_PPC_REL14:
+		writer.patchAt<uint32_t>(offset, (writer.readAt<uint32_t>(offset) & ~0xFFFC) | (delta & 0xFFFC));
+		return true;
+	case R_PPC_REL14_BRTAKEN:
+	case R_PPC_REL14_BRNKTAKEN:
+	{
+		uint32_t instruction = (writer.readAt<uint32_t>(offset) & ~0xFFFC) | (delta & 0xFFFC);
+		// The y bit reverses the default prediction of backward branches
+		// taken and forward ones not, it means nothing for branch always
+		const uint32_t cBranchAlways = 0x14 << 21, cPredictionBit = 1 << 21;
+		if ((instruction & cBranchAlways) != cBranchAlways)
+		{
+			bool isTaken = type == R_PPC_REL14_BRTAKEN;
+			bool isBackward = static_cast<int32_t>(delta) < 0;
+			instruction = isTaken != isBackward ? instruction | cPredictionBit : instruction & ~cPredictionBit;
+		}
+		writer.patchAt<uint32_t>(offset, instruction);
+		return true;
+	}
+	case R_PPC_REL32:
+		writer.patchAt<uint32_t>(offset, delta);
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Whether the displacement of a relative relocation fits its field. Branch
+// displacements also have to be word aligned, the low bits of the field
+// belong to the instruction.
+bool fitsRelativeRelocation(int type, int32_t delta)
+{
+	switch (type)
+	{
+	case R_PPC_REL24:
+		return delta >= -0x2000000 && delta < 0x2000000 && (delta & 3) == 0;
+	case R_PPC_REL14:
+	case R_PPC_REL14_BRTAKEN:
+	case R_PPC_REL14_BRNKTAKEN:
+		return delta >= -0x8000 && delta < 0x8000 && (delta & 3) == 0;
+	case R_PPC_REL32:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// A prelinked REL is preceded by this block, right before the section table:
+// magic, expected module address, expected bss address and the size of the
+// import table that the header leaves out. The REL loader only hands the
+// import table to OSLink if the addresses don't match.
+const uint32_t cPrelinkMagic = 0x504C4E4B; // 'PLNK'
+const int cPrelinkInfoSize = 0x10;
+
+void writePrelinkInfo(RelWriter &writer, int offset, uint32_t base, uint32_t bssBase, int importInfoSize)
+{
+	writer.patchAt<uint32_t>(offset, cPrelinkMagic);
+	writer.patchAt<uint32_t>(offset + 0x4, base);
+	writer.patchAt<uint32_t>(offset + 0x8, bssBase);
+	writer.patchAt<uint32_t>(offset + 0xC, importInfoSize);
+}
+
+// Runs every relocation in the import table against the image, as OSLink
+// would if the REL was loaded at base with its bss at bssBase. Imports from
+// game RELs are skipped, where those end up is only known once loaded. The
+// table itself is left alone.
+bool prelinkRelocations(RelWriter &writer,
+						int moduleID,
+						int sectionInfoOffset,
+						int sectionCount,
+						int importInfoOffset,
+						int importInfoSize,
+						uint32_t base,
+						uint32_t bssBase,
+						size_t &appliedCount,
+						std::string &log)
+{
+	// OSLink hands out bss in section order
+	std::vector<uint32_t> sectionAddresses(sectionCount, 0);
+	uint32_t bssAddress = bssBase;
+	for (int i = 0; i < sectionCount; ++i)
+	{
+		uint32_t offset = writer.readAt<uint32_t>(sectionInfoOffset + i * 8);
+		uint32_t size = writer.readAt<uint32_t>(sectionInfoOffset + i * 8 + 4);
+		if (offset != 0)
+		{
+			sectionAddresses[i] = base + (offset & ~1u);
+		}
+		else if (size != 0)
+		{
+			sectionAddresses[i] = bssAddress;
+			bssAddress += size;
+		}
+	}
+
+	for (int i = 0; i < importInfoSize / 8; ++i)
+	{
+		uint32_t importID = writer.readAt<uint32_t>(importInfoOffset + i * 8);
+		size_t position = writer.readAt<uint32_t>(importInfoOffset + i * 8 + 4);
+		if (importID != 0 && importID != static_cast<uint32_t>(moduleID))
+		{
+			continue;
+		}
+
+		uint32_t address = 0;
+		for (;; position += 8)
+		{
+			int type = writer.readAt<uint8_t>(position + 2);
+			int section = writer.readAt<uint8_t>(position + 3);
+			if (type == R_DOLPHIN_END)
+			{
+				break;
+			}
+			if (type == R_DOLPHIN_SECTION)
+			{
+				address = sectionAddresses[section];
+				continue;
+			}
+
+			address += writer.readAt<uint16_t>(position);
+			if (type == R_DOLPHIN_NOP || type == R_PPC_NONE)
+			{
+				continue;
+			}
+
+			uint32_t addend = writer.readAt<uint32_t>(position + 4);
+			uint32_t value = importID == 0 ? addend : sectionAddresses[section] + addend;
+			int offset = static_cast<int>(address - base);
+			if (!applyAbsoluteRelocation(writer, offset, type, value)
+				&& !applyRelativeRelocation(writer, offset, type, value, address))
+			{
+				appendFormat(log, "Can't prelink relocation type %d\n", type);
+				return false;
+			}
+			++appliedCount;
+		}
+	}
+	return true;
+}
+
+const std::vector<std::string> cRelSectionMask = {
+	".init",
+	".text",
+	".ctors",
+	".dtors",
+	".rodata",
+	".data",
+	".bss"
+};
+
+// One ELF to REL conversion
+struct ConversionJob
+{
+	std::string elfFilename;
+	std::string lstFilename;
+	std::string relFilename;
+	// Symbol maps of game RELs by their module ID
+	std::vector<std::pair<uint32_t, std::string>> moduleLstFilenames;
+	int moduleID = 0x1000;
+	int relVersion = 3;
+	// Skip the conversion if the inputs hash the same as last time
+	bool incremental = false;
+	// Leave absolute relocations against the DOL to OSLink
+	bool keepDolRelocations = false;
+	// Resolve everything for this load address up front, 0 to leave it to
+	// OSLink. The bss address defaults to where the REL loader puts it.
+	uint32_t prelinkBase = 0;
+	uint32_t prelinkBssBase = 0;
+	// Drop sections that nothing reachable refers to
+	bool gcSections = false;
+	// Order sections within each REL section to waste less on alignment
+	bool packSections = false;
+	// Symbols to keep alive besides the entry points and constructors
+	std::vector<std::string> rootSymbols;
+	// Function hit counts to order .text by, none if empty
+	std::string profileFilename;
+	// Keep identical SHF_MERGE constants and strings only once
+	bool mergeConstants = false;
+	// Fold identical .text sections, also ones whose address is taken
+	bool foldIdenticalCode = false;
+	bool foldAddressTaken = false;
+	// Call DOL functions called from at least this many places through a
+	// single branch in .text, 0 to call them directly
+	int branchStubMinCalls = 0;
+	// Write where every global symbol ended up, for other modules to import
+	bool writeExportMap = false;
+};
+
+// Hit count of one function from a --profile file
+struct ProfileEntry
+{
+	std::string symbol;
+	uint64_t hitCount = 0;
+};
+
+// Input ELF with everything the conversion reads decoded or fetched up
+// front. After loading it is only ever read from, so any number of
+// conversions can share it, also in parallel.
+struct InputElf
+{
+	ELFIO::elfio elf;
+	ELFIO::section *symSection = nullptr;
+	std::vector<ELFIO::section *> relocationSections;
+	std::unique_ptr<SymbolIndex> symbols;
+};
+
+// Every kept input section is merged into one REL section per entry of
+// cRelSectionMask, numbered from 1 in mask order. The last one is bss.
+const int cRelSectionCount = static_cast<int>(cRelSectionMask.size()) + 1;
+const int cRelBssSection = cRelSectionCount - 1;
+const int cRelTextSection = 2;
+
+// REL section an input section is merged into, 0 if it isn't kept. Anything
+// without data goes to bss and anything with data to .data, whatever the
+// name says.
+int getRelSectionIndex(const ELFIO::section *section)
+{
+	std::string name = section->get_name();
+	auto it = std::find_if(cRelSectionMask.begin(),
+						   cRelSectionMask.end(),
+						   [&](const std::string &val)
+	{
+		return val == name
+			   || name.compare(0, val.size() + 1, val + ".") == 0;
+	});
+	if (it == cRelSectionMask.end())
+	{
+		return 0;
+	}
+
+	int index = static_cast<int>(it - cRelSectionMask.begin()) + 1;
+	if (section->get_type() == SHT_NOBITS)
+	{
+		return cRelBssSection;
+	}
+	if (index == cRelBssSection)
+	{
+		return cRelBssSection - 1;
+	}
+	return index;
+}
+
+bool shouldKeepSection(const ELFIO::section *section)
+{
+	return getRelSectionIndex(section) != 0;
+}
+
+bool loadInputElf(InputElf &input, const std::string &filename)
+{
+	// Section data is read straight out of the mapping
+	if (!input.elf.load_mapped(filename))
+	{
+		return false;
+	}
+
+	// Find special sections
+	for (const auto &section : input.elf.sections)
+	{
+		if (section->get_type() == SHT_SYMTAB)
+		{
+			input.symSection = section;
+		}
+		else if (section->get_type() == SHT_RELA)
+		{
+			input.relocationSections.emplace_back(section);
+		}
+	}
+
+	// Fetch the data of everything that gets written or relocated now, so the
+	// workers don't queue up on the first access of a section
+	for (const auto &section : input.elf.sections)
+	{
+		if (shouldKeepSection(section))
+		{
+			section->get_data();
+		}
+	}
+	for (const auto &section : input.relocationSections)
+	{
+		uint32_t relocatedSectionIndex = section->get_info();
+		if (relocatedSectionIndex < input.elf.sections.size()
+			&& shouldKeepSection(input.elf.sections[relocatedSectionIndex]))
+		{
+			section->get_data();
+		}
+	}
+
+	// Decode the symbol table once, everything below reads from the index
+	input.symbols = std::make_unique<SymbolIndex>(input.elf, input.symSection);
+	return true;
+}
+
+// Numbers reported by --stats
+struct ConversionStats
+{
+	// Skipped by --incremental, nothing else is filled in
+	bool upToDate = false;
+
+	// Relocations left for OSLink, by type and by module they resolve against
+	std::map<int, size_t> relocationCounts;
+	std::map<uint32_t, size_t> moduleRelocationCounts;
+	size_t earlyResolvedCount = 0;
+	size_t dolResolvedCount = 0;
+	size_t nopCount = 0;
+	// Relocations applied for --prelink-base, 0 addresses if not prelinked
+	size_t prelinkedCount = 0;
+	uint32_t prelinkBase = 0;
+	uint32_t prelinkBssBase = 0;
+
+	// Sections dropped by --gc-sections
+	size_t deadSectionCount = 0;
+	size_t deadSectionSize = 0;
+	size_t deadBssSize = 0;
+
+	// Bytes --pack-sections saved compared to ELF order
+	size_t packedSaving = 0;
+	size_t packedBssSaving = 0;
+
+	// .text sections ordered by --profile
+	size_t hotSectionCount = 0;
+	size_t hotSectionSize = 0;
+	size_t coldSectionCount = 0;
+	size_t unknownProfileSymbolCount = 0;
+
+	// Duplicate entries dropped by --merge-constants
+	size_t mergedEntryCount = 0;
+	size_t mergedSaving = 0;
+
+	// .text sections dropped by --icf for an identical one
+	size_t foldedSectionCount = 0;
+	size_t foldedSize = 0;
+
+	// DOL functions called through a stub by --branch-stubs
+	size_t branchStubCount = 0;
+	size_t branchStubCallCount = 0;
+
+	// Global symbols written to the export map
+	size_t exportedSymbolCount = 0;
+
+	size_t paddingSize = 0;
+	size_t sectionDataSize = 0;
+	size_t bssSize = 0;
+	size_t importTableSize = 0;
+	size_t relocationTableSize = 0;
+	size_t totalSize = 0;
+};
+
+const char *getRelocationTypeName(int type)
+{
+	switch (type)
+	{
+	case R_PPC_NONE: return "R_PPC_NONE";
+	case R_PPC_ADDR32: return "R_PPC_ADDR32";
+	case R_PPC_ADDR24: return "R_PPC_ADDR24";
+	case R_PPC_ADDR16: return "R_PPC_ADDR16";
+	case R_PPC_ADDR16_LO: return "R_PPC_ADDR16_LO";
+	case R_PPC_ADDR16_HI: return "R_PPC_ADDR16_HI";
+	case R_PPC_ADDR16_HA: return "R_PPC_ADDR16_HA";
+	case R_PPC_ADDR14: return "R_PPC_ADDR14";
+	case R_PPC_ADDR14_BRTAKEN: return "R_PPC_ADDR14_BRTAKEN";
+	case R_PPC_ADDR14_BRNKTAKEN: return "R_PPC_ADDR14_BRNKTAKEN";
+	case R_PPC_REL24: return "R_PPC_REL24";
+	case R_PPC_REL14: return "R_PPC_REL14";
+	case R_PPC_REL14_BRTAKEN: return "R_PPC_REL14_BRTAKEN";
+	case R_PPC_REL14_BRNKTAKEN: return "R_PPC_REL14_BRNKTAKEN";
+	case R_PPC_REL32: return "R_PPC_REL32";
+	case R_DOLPHIN_NOP: return "R_DOLPHIN_NOP";
+	case R_DOLPHIN_SECTION: return "R_DOLPHIN_SECTION";
+	case R_DOLPHIN_END: return "R_DOLPHIN_END";
+	default: return "unknown";
+	}
+}
+
+// Bump whenever a change to elf2rel changes the output for the same input,
+// so that incremental runs don't keep stale RELs around
+const uint32_t cIncrementalVersion = 5;
+
+// Hash of everything the REL is built from: the kept sections, the
+// relocations applied to them, the symbol table, the external symbols it
+// refers to and the job options. Other sections, debug info in particular,
+// are left out, changing only those doesn't rewrite the REL.
+uint64_t hashConversionInputs(const InputElf &input,
+							  const ExternalSymbols &externalSymbols,
+							  const std::vector<ProfileEntry> &profile,
+							  const ConversionJob &job)
+{
+	ContentHash hash;
+	hash.updateValue<uint32_t>(cIncrementalVersion);
+	hash.updateValue<int32_t>(job.moduleID);
+	hash.updateValue<int32_t>(job.relVersion);
+	hash.updateValue<uint8_t>(job.keepDolRelocations);
+	hash.updateValue<uint32_t>(job.prelinkBase);
+	hash.updateValue<uint32_t>(job.prelinkBssBase);
+	hash.updateValue<uint8_t>(job.gcSections);
+	hash.updateValue<uint8_t>(job.packSections);
+	hash.updateValue<uint8_t>(job.mergeConstants);
+	hash.updateValue<uint8_t>(job.foldIdenticalCode);
+	hash.updateValue<uint8_t>(job.foldAddressTaken);
+	hash.updateValue<int32_t>(job.branchStubMinCalls);
+	hash.updateValue<uint8_t>(job.writeExportMap);
+	hash.updateValue<uint32_t>(job.rootSymbols.size());
+	for (const auto &rootSymbol : job.rootSymbols)
+	{
+		hash.update(rootSymbol);
+	}
+	hash.updateValue<uint32_t>(profile.size());
+	for (const auto &entry : profile)
+	{
+		hash.update(entry.symbol);
+		hash.updateValue<uint64_t>(entry.hitCount);
+	}
+
+	const ELFIO::elfio &elf = input.elf;
+	hash.updateValue<uint32_t>(elf.sections.size());
+	for (const auto &section : elf.sections)
+	{
+		if (shouldKeepSection(section))
+		{
+			hash.updateValue<uint32_t>(section->get_index());
+			hash.update(section->get_name());
+			hash.updateValue<uint32_t>(section->get_type());
+			hash.updateValue<uint64_t>(section->get_flags());
+			hash.updateValue<uint64_t>(section->get_addr_align());
+			hash.updateValue<uint64_t>(section->get_size());
+			if (section->get_type() != SHT_NOBITS && section->get_data())
+			{
+				hash.update(section->get_data(), section->get_size());
+			}
+		}
+	}
+	for (const auto &section : input.relocationSections)
+	{
+		uint32_t relocatedSectionIndex = section->get_info();
+		if (relocatedSectionIndex < elf.sections.size()
+			&& shouldKeepSection(elf.sections[relocatedSectionIndex])
+			&& section->get_data())
+		{
+			hash.updateValue<uint32_t>(relocatedSectionIndex);
+			hash.updateValue<uint64_t>(section->get_entry_size());
+			hash.updateValue<uint64_t>(section->get_size());
+			hash.update(section->get_data(), section->get_size());
+		}
+	}
+
+	const SymbolIndex &symbols = *input.symbols;
+	hash.updateValue<uint32_t>(symbols.size());
+	for (uint32_t i = 0; i < symbols.size(); ++i)
+	{
+		std::string_view name = symbols.getName(i);
+		hash.update(name);
+		hash.updateValue<uint32_t>(symbols.getValue(i));
+		hash.updateValue<uint16_t>(symbols.getSectionIndex(i));
+		hash.updateValue<uint8_t>(symbols.getBind(i));
+
+		// Undefined, so it resolves against the symbol map or a game REL
+		uint32_t address, moduleID, section;
+		if (symbols.getSectionIndex(i) == 0 && !name.empty() && externalSymbols.find(name, address))
+		{
+			hash.updateValue<uint32_t>(address);
+		}
+		else if (symbols.getSectionIndex(i) == 0 && !name.empty() && externalSymbols.findInModule(name, moduleID, section, address))
+		{
+			hash.updateValue<uint32_t>(moduleID);
+			hash.updateValue<uint32_t>(section);
+			hash.updateValue<uint32_t>(address);
+		}
+	}
+
+	return hash.finish();
+}
+
+// The hash of the last conversion is kept next to the REL together with its
+// size and diagnostics. The REL counts as current if hash and size still
+// match, the diagnostics are then repeated so skipping doesn't hide them.
+std::string getHashFilename(const ConversionJob &job)
+{
+	return job.relFilename + ".hash";
+}
+
+// The export map is kept next to the REL as <rel>.lst, appending instead of
+// replacing the extension so it can't be mistaken for the mod's symbol map
+std::string getExportMapFilename(const ConversionJob &job)
+{
+	return job.relFilename + ".lst";
+}
+
+bool isOutputCurrent(const ConversionJob &job, uint64_t inputHash, std::string &log)
+{
+	std::ifstream inputStream(getHashFilename(job), std::ios::binary);
+	unsigned long long storedHash = 0, storedSize = 0;
+	if (!(inputStream >> std::hex >> storedHash >> std::dec >> storedSize) || inputStream.get() != '\n')
+	{
+		return false;
+	}
+
+	std::error_code error;
+	uint64_t outputSize = std::filesystem::file_size(job.relFilename, error);
+	if (error || storedHash != inputHash || storedSize != outputSize)
+	{
+		return false;
+	}
+	if (job.writeExportMap && !std::filesystem::exists(getExportMapFilename(job), error))
+	{
+		return false;
+	}
+
+	log.append(std::istreambuf_iterator<char>(inputStream), std::istreambuf_iterator<char>());
+	return true;
+}
+
+// Data placed as a unit within a REL section: an input section, or a block
+// of merged constants standing in for several of them
+struct SectionPiece
+{
+	// For merged blocks the first of the merged sections, null for the
+	// branch stubs
+	const ELFIO::section *section = nullptr;
+	const char *data = nullptr;
+	uint32_t size = 0;
+	uint32_t align = 1;
+};
+
+// Places sections one after another in the given order, each at its own
+// alignment. Returns the size of the whole run.
+uint32_t layoutSectionsInOrder(const std::vector<SectionPiece> &sections, std::vector<uint32_t> &offsets)
+{
+	uint32_t size = 0;
+	offsets.resize(sections.size());
+	for (size_t i = 0; i < sections.size(); ++i)
+	{
+		uint32_t align = sections[i].align;
+		offsets[i] = (size + align - 1) & ~(align - 1);
+		size = offsets[i] + sections[i].size;
+	}
+	return size;
+}
+
+// Places sections most aligned first, and less aligned ones into the gaps
+// that alignment leaves behind where they fit. Sections of the same
+// alignment keep their order. Returns the size of the whole run.
+uint32_t layoutSectionsPacked(const std::vector<SectionPiece> &sections, std::vector<uint32_t> &offsets)
+{
+	auto getAlign = [&](size_t index)
+	{
+		return sections[index].align;
+	};
+
+	std::vector<size_t> order(sections.size());
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](size_t left, size_t right)
+	{
+		return getAlign(left) > getAlign(right);
+	});
+
+	// Unused [start, end) ranges between placed sections
+	std::vector<std::pair<uint32_t, uint32_t>> gaps;
+	uint32_t size = 0;
+	offsets.resize(sections.size());
+	for (size_t index : order)
+	{
+		uint32_t align = getAlign(index);
+		uint32_t sectionSize = sections[index].size;
+
+		auto gap = std::find_if(gaps.begin(), gaps.end(), [&](const std::pair<uint32_t, uint32_t> &range)
+		{
+			return ((range.first + align - 1) & ~(align - 1)) + sectionSize <= range.second;
+		});
+		if (gap != gaps.end())
+		{
+			uint32_t gapStart = gap->first, gapEnd = gap->second;
+			uint32_t offset = (gapStart + align - 1) & ~(align - 1);
+			offsets[index] = offset;
+
+			gap = gaps.erase(gap);
+			if (offset + sectionSize < gapEnd)
+			{
+				gap = gaps.insert(gap, { offset + sectionSize, gapEnd });
+			}
+			if (gapStart < offset)
+			{
+				gaps.insert(gap, { gapStart, offset });
+			}
+			continue;
+		}
+
+		uint32_t offset = (size + align - 1) & ~(align - 1);
+		if (size < offset)
+		{
+			gaps.emplace_back(size, offset);
+		}
+		offsets[index] = offset;
+		size = offset + sectionSize;
+	}
+	return size;
+}
+
+// Marks the kept sections reachable through relocations from the entry
+// points, the static constructors and destructors and the given extra root
+// symbols. Everything else can't be reached at runtime and is dropped.
+std::vector<bool> findLiveSections(const InputElf &input, const std::vector<std::string> &rootSymbols, std::string &log)
+{
+	const ELFIO::elfio &inputElf = input.elf;
+	const SymbolIndex &symbols = *input.symbols;
+
+	std::vector<std::vector<ELFIO::section *>> relocationSectionsByTarget(inputElf.sections.size());
+	for (const auto &section : input.relocationSections)
+	{
+		if (section->get_info() < inputElf.sections.size())
+		{
+			relocationSectionsByTarget[section->get_info()].emplace_back(section);
+		}
+	}
+
+	std::vector<bool> liveSections(inputElf.sections.size(), false);
+	std::vector<uint32_t> pendingSections;
+	auto markSection = [&](uint32_t sectionIndex)
+	{
+		if (sectionIndex < liveSections.size()
+			&& !liveSections[sectionIndex]
+			&& shouldKeepSection(inputElf.sections[sectionIndex]))
+		{
+			liveSections[sectionIndex] = true;
+			pendingSections.emplace_back(sectionIndex);
+		}
+	};
+
+	for (const auto &section : inputElf.sections)
+	{
+		int relSectionIndex = getRelSectionIndex(section);
+		if (relSectionIndex != 0
+			&& (cRelSectionMask[relSectionIndex - 1] == ".ctors" || cRelSectionMask[relSectionIndex - 1] == ".dtors"))
+		{
+			markSection(section->get_index());
+		}
+	}
+
+	for (const char *entryPoint : { "_prolog", "_epilog", "_unresolved" })
+	{
+		uint32_t index = symbols.find(entryPoint);
+		if (index != SymbolIndex::cInvalidIndex)
+		{
+			markSection(symbols.getSectionIndex(index));
+		}
+	}
+	for (const auto &rootSymbol : rootSymbols)
+	{
+		uint32_t index = symbols.find(rootSymbol);
+		if (index == SymbolIndex::cInvalidIndex)
+		{
+			appendFormat(log, "Root symbol '%s' not found\n", rootSymbol.c_str());
+			continue;
+		}
+		markSection(symbols.getSectionIndex(index));
+	}
+
+	while (!pendingSections.empty())
+	{
+		uint32_t sectionIndex = pendingSections.back();
+		pendingSections.pop_back();
+
+		for (const auto &section : relocationSectionsByTarget[sectionIndex])
+		{
+			ELFIO::relocation_section_accessor relocations(inputElf, section);
+			for (ELFIO::Elf_Xword i = 0; i < relocations.get_entries_num(); ++i)
+			{
+				ELFIO::Elf64_Addr offset = 0;
+				ELFIO::Elf_Word symbol = 0;
+				ELFIO::Elf_Word type = R_PPC_NONE;
+				ELFIO::Elf_Sxword addend = 0;
+				relocations.get_entry(i, offset, symbol, type, addend);
+				if (type != R_PPC_NONE && symbol < symbols.size())
+				{
+					markSection(symbols.getSectionIndex(symbol));
+				}
+			}
+		}
+	}
+
+	return liveSections;
+}
+
+// Reads a function profile, for example hit counts exported from an
+// emulator. Every line is a symbol name as it appears in the ELF followed by
+// how often it was run. Blank lines and // comments are ignored.
+bool loadFunctionProfile(const std::string &filename, std::vector<ProfileEntry> &profile, std::string &log)
+{
+	std::ifstream inputStream(filename);
+	if (!inputStream)
+	{
+		appendFormat(log, "Failed to open profile '%s'\n", filename.c_str());
+		return false;
+	}
+
+	int lineNumber = 0;
+	for (std::string line; std::getline(inputStream, line); )
+	{
+		++lineNumber;
+
+		// Ignore comments
+		size_t commentStart = line.find("//");
+		if (commentStart != std::string::npos)
+		{
+			line.erase(commentStart);
+		}
+		boost::trim(line);
+		if (line.empty())
+		{
+			continue;
+		}
+
+		size_t countStart = line.find_last_of(" \t");
+		char *countEnd = nullptr;
+		ProfileEntry entry;
+		if (countStart != std::string::npos)
+		{
+			entry.symbol = boost::trim_copy(line.substr(0, countStart));
+			entry.hitCount = strtoull(line.c_str() + countStart + 1, &countEnd, 0);
+		}
+		if (entry.symbol.empty() || !countEnd || *countEnd != '\0')
+		{
+			appendFormat(log, "%s:%d: Expected <symbol> <count>\n", filename.c_str(), lineNumber);
+			return false;
+		}
+		profile.emplace_back(std::move(entry));
+	}
+
+	return true;
+}
+
+// Orders .text sections for instruction cache locality: sections of
+// profiled functions first, most run first, then everything the profile
+// doesn't know in ELF order. Code run at most once and the entry points
+// go last, they only get in the way of the per frame code.
+void orderSectionsByProfile(std::vector<const ELFIO::section *> &sections,
+							const SymbolIndex &symbols,
+							const std::vector<ProfileEntry> &profile,
+							ConversionStats &stats)
+{
+	std::map<uint32_t, uint64_t> sectionHitCounts;
+	for (const auto &entry : profile)
+	{
+		uint32_t index = symbols.find(entry.symbol);
+		if (index == SymbolIndex::cInvalidIndex)
+		{
+			++stats.unknownProfileSymbolCount;
+			continue;
+		}
+		sectionHitCounts[symbols.getSectionIndex(index)] += entry.hitCount;
+	}
+
+	std::set<uint32_t> entryPointSections;
+	for (const char *entryPoint : { "_prolog", "_epilog", "_unresolved" })
+	{
+		uint32_t index = symbols.find(entryPoint);
+		if (index != SymbolIndex::cInvalidIndex)
+		{
+			entryPointSections.insert(symbols.getSectionIndex(index));
+		}
+	}
+
+	// 0 hot, 1 not profiled, 2 cold
+	auto getRank = [&](const ELFIO::section *section)
+	{
+		auto it = sectionHitCounts.find(section->get_index());
+		if (entryPointSections.count(section->get_index()) || (it != sectionHitCounts.end() && it->second <= 1))
+		{
+			return 2;
+		}
+		return it != sectionHitCounts.end() ? 0 : 1;
+	};
+	std::stable_sort(sections.begin(), sections.end(), [&](const ELFIO::section *left, const ELFIO::section *right)
+	{
+		int leftRank = getRank(left);
+		int rightRank = getRank(right);
+		if (leftRank != rightRank)
+		{
+			return leftRank < rightRank;
+		}
+		return leftRank == 0 && sectionHitCounts.at(left->get_index()) > sectionHitCounts.at(right->get_index());
+	});
+
+	for (const auto &section : sections)
+	{
+		int rank = getRank(section);
+		if (rank == 0)
+		{
+			++stats.hotSectionCount;
+			stats.hotSectionSize += section->get_size();
+		}
+		else if (rank == 2)
+		{
+			++stats.coldSectionCount;
+		}
+	}
+}
+
+// Distinct entries of one kind of SHF_MERGE section, written in place of
+// all sections merged into it
+struct MergedBlock
+{
+	std::vector<char> data;
+	uint32_t align = 1;
+	// The sections merged, the block takes the place of the first one
+	std::vector<uint32_t> sectionIndices;
+};
+
+// Where the entries of a merged section ended up in its block, as
+// (section offset, block offset) pairs sorted by section offset
+struct MergedInput
+{
+	uint32_t block = 0;
+	std::vector<std::pair<uint32_t, uint32_t>> entries;
+};
+
+// Block offset an offset into a merged section ends up at, anything past
+// the start of an entry moves with it
+uint32_t getMergedOffset(const MergedInput &input, uint32_t offset)
+{
+	auto it = std::upper_bound(input.entries.begin(), input.entries.end(), offset,
+							   [](uint32_t value, const std::pair<uint32_t, uint32_t> &entry)
+	{
+		return value < entry.first;
+	});
+	if (it == input.entries.begin())
+	{
+		return offset;
+	}
+	--it;
+	return it->second + (offset - it->first);
+}
+
+// Deduplicates the entries of the SHF_MERGE sections among sections. The
+// sections of each kind (strings or constants, entry size and alignment)
+// are replaced by one block of their distinct entries, in the place of the
+// first one of them. Strings that are the tail of another string share its
+// bytes. Sections that get relocated themselves are left alone.
+void mergeConstants(std::vector<const ELFIO::section *> &sections,
+					const std::vector<bool> &relocatedSections,
+					std::vector<MergedBlock> &blocks,
+					std::map<uint32_t, MergedInput> &mergedInputs,
+					ConversionStats &stats)
+{
+	using GroupKey = std::tuple<bool, uint32_t, uint32_t>;
+	std::map<GroupKey, std::vector<const ELFIO::section *>> groups;
+	for (const auto &section : sections)
+	{
+		uint32_t entrySize = static_cast<uint32_t>(section->get_entry_size());
+		if ((section->get_flags() & SHF_MERGE)
+			&& section->get_type() == SHT_PROGBITS
+			&& section->get_data()
+			&& entrySize != 0
+			&& section->get_size() % entrySize == 0
+			&& !relocatedSections[section->get_index()])
+		{
+			bool isStrings = (section->get_flags() & SHF_STRINGS) != 0;
+			uint32_t align = std::max(static_cast<uint32_t>(section->get_addr_align()), 1u);
+			groups[GroupKey(isStrings, entrySize, align)].emplace_back(section);
+		}
+	}
+
+	std::set<uint32_t> droppedSections;
+	for (const auto &group : groups)
+	{
+		bool isStrings = std::get<0>(group.first);
+		uint32_t entrySize = std::get<1>(group.first);
+		uint32_t align = std::get<2>(group.first);
+
+		// Split into entries. Strings run up to and including their terminator
+		// and each one starts aligned, constants are entrySize apart.
+		std::vector<std::vector<std::pair<uint32_t, std::string_view>>> sectionEntries;
+		uint32_t inputSize = 0;
+		for (const auto &section : group.second)
+		{
+			const char *data = section->get_data();
+			uint32_t size = static_cast<uint32_t>(section->get_size());
+			inputSize += size;
+
+			auto &entries = sectionEntries.emplace_back();
+			for (uint32_t offset = 0; offset < size; )
+			{
+				uint32_t length = entrySize;
+				if (isStrings)
+				{
+					length = 0;
+					while (offset + length + entrySize <= size
+						   && std::any_of(data + offset + length, data + offset + length + entrySize, [](char c) { return c != 0; }))
+					{
+						length += entrySize;
+					}
+					length = std::min(length + entrySize, size - offset);
+				}
+				entries.emplace_back(offset, std::string_view(data + offset, length));
+				offset = isStrings ? (offset + length + align - 1) & ~(align - 1) : offset + length;
+			}
+		}
+
+		MergedBlock block;
+		block.align = align;
+		std::map<std::string_view, uint32_t> blockOffsets;
+		size_t entryCount = 0;
+		for (const auto &entries : sectionEntries)
+		{
+			entryCount += entries.size();
+			for (const auto &entry : entries)
+			{
+				blockOffsets.emplace(entry.second, 0);
+			}
+		}
+
+		auto appendEntry = [&](std::string_view entry)
+		{
+			uint32_t step = isStrings ? align : entrySize;
+			block.data.resize((block.data.size() + step - 1) / step * step);
+			uint32_t offset = static_cast<uint32_t>(block.data.size());
+			block.data.insert(block.data.end(), entry.begin(), entry.end());
+			return offset;
+		};
+		size_t distinctCount = blockOffsets.size();
+		if (isStrings)
+		{
+			// Sorted by their reversed contents, a string that is the tail of
+			// others comes right after the longest of them
+			std::vector<std::string_view> strings;
+			for (const auto &entry : blockOffsets)
+			{
+				strings.emplace_back(entry.first);
+			}
+			std::sort(strings.begin(), strings.end(), [](std::string_view left, std::string_view right)
+			{
+				return std::lexicographical_compare(right.rbegin(), right.rend(), left.rbegin(), left.rend());
+			});
+
+			for (size_t i = 0; i < strings.size(); ++i)
+			{
+				std::string_view string = strings[i];
+				if (i != 0)
+				{
+					std::string_view previous = strings[i - 1];
+					uint32_t tailOffset = blockOffsets[previous] + static_cast<uint32_t>(previous.size() - string.size());
+					if (previous.size() > string.size()
+						&& previous.compare(previous.size() - string.size(), string.size(), string) == 0
+						&& (previous.size() - string.size()) % entrySize == 0
+						&& tailOffset % align == 0)
+					{
+						blockOffsets[string] = tailOffset;
+						--distinctCount;
+						continue;
+					}
+				}
+				blockOffsets[string] = appendEntry(string);
+			}
+		}
+		else
+		{
+			// First come first placed
+			std::set<std::string_view> placed;
+			for (const auto &entries : sectionEntries)
+			{
+				for (const auto &entry : entries)
+				{
+					if (placed.insert(entry.second).second)
+					{
+						blockOffsets[entry.second] = appendEntry(entry.second);
+					}
+				}
+			}
+		}
+
+		// Alignment within the block can cost more than duplicates save
+		if (block.data.size() >= inputSize)
+		{
+			continue;
+		}
+		stats.mergedEntryCount += entryCount - distinctCount;
+		stats.mergedSaving += inputSize - block.data.size();
+
+		uint32_t blockIndex = static_cast<uint32_t>(blocks.size());
+		for (size_t i = 0; i < group.second.size(); ++i)
+		{
+			uint32_t sectionIndex = group.second[i]->get_index();
+			block.sectionIndices.emplace_back(sectionIndex);
+			if (i != 0)
+			{
+				droppedSections.insert(sectionIndex);
+			}
+
+			MergedInput &mergedInput = mergedInputs[sectionIndex];
+			mergedInput.block = blockIndex;
+			for (const auto &entry : sectionEntries[i])
+			{
+				mergedInput.entries.emplace_back(entry.first, blockOffsets.at(entry.second));
+			}
+		}
+		blocks.emplace_back(std::move(block));
+	}
+
+	sections.erase(std::remove_if(sections.begin(), sections.end(), [&](const ELFIO::section *section)
+	{
+		return droppedSections.count(section->get_index()) != 0;
+	}), sections.end());
+}
+
+// Relocation types that only ever branch to their target and so don't
+// make its address visible
+bool isBranchRelocation(uint32_t type)
+{
+	switch (type)
+	{
+	case R_PPC_ADDR24:
+	case R_PPC_ADDR14:
+	case R_PPC_ADDR14_BRTAKEN:
+	case R_PPC_ADDR14_BRNKTAKEN:
+	case R_PPC_REL24:
+	case R_PPC_REL14:
+	case R_PPC_REL14_BRTAKEN:
+	case R_PPC_REL14_BRNKTAKEN:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Finds the .text sections with identical code, alignment and relocations
+// against identical targets. Identical targets are found by refining
+// classes of candidates until they don't split any more, so sections
+// calling each other fold as well. Sections whose address is used for
+// anything but branches are left alone unless foldAddressTaken is set,
+// code may compare function pointers. Returns the section every input
+// section is folded into, 0 if it is kept. The first of every class in
+// the given order is kept.
+std::vector<uint32_t> findIdenticalSections(const InputElf &input,
+											const std::vector<const ELFIO::section *> &sections,
+											bool foldAddressTaken)
+{
+	const ELFIO::elfio &inputElf = input.elf;
+	const SymbolIndex &symbols = *input.symbols;
+	uint32_t sectionCount = static_cast<uint32_t>(inputElf.sections.size());
+
+	struct Target
+	{
+		uint32_t offset;
+		uint32_t type;
+		uint32_t symbol;
+		int64_t addend;
+	};
+	std::vector<std::vector<Target>> sectionTargets(sectionCount);
+	std::vector<bool> isAddressTaken(sectionCount, false);
+	for (const auto &section : input.relocationSections)
+	{
+		uint32_t relocatedSectionIndex = section->get_info();
+		if (relocatedSectionIndex >= sectionCount || !shouldKeepSection(inputElf.sections[relocatedSectionIndex]))
+		{
+			continue;
+		}
+
+		ELFIO::relocation_section_accessor relocations(inputElf, section);
+		for (ELFIO::Elf_Xword i = 0; i < relocations.get_entries_num(); ++i)
+		{
+			ELFIO::Elf64_Addr offset = 0;
+			ELFIO::Elf_Word symbol = 0;
+			ELFIO::Elf_Word type = R_PPC_NONE;
+			ELFIO::Elf_Sxword addend = 0;
+			relocations.get_entry(i, offset, symbol, type, addend);
+			if (type == R_PPC_NONE)
+			{
+				continue;
+			}
+
+			sectionTargets[relocatedSectionIndex].push_back({ static_cast<uint32_t>(offset), type, symbol, addend });
+			if (symbol < symbols.size() && !isBranchRelocation(type) && symbols.getSectionIndex(symbol) < sectionCount)
+			{
+				isAddressTaken[symbols.getSectionIndex(symbol)] = true;
+			}
+		}
+	}
+
+	std::set<uint32_t> entryPointSections;
+	for (const char *entryPoint : { "_prolog", "_epilog", "_unresolved" })
+	{
+		uint32_t index = symbols.find(entryPoint);
+		if (index != SymbolIndex::cInvalidIndex)
+		{
+			entryPointSections.insert(symbols.getSectionIndex(index));
+		}
+	}
+
+	std::vector<const ELFIO::section *> candidates;
+	std::vector<int> candidateIndices(sectionCount, -1);
+	for (const auto &section : sections)
+	{
+		uint32_t index = section->get_index();
+		if (section->get_size() != 0
+			&& section->get_data()
+			&& !entryPointSections.count(index)
+			&& (foldAddressTaken || !isAddressTaken[index]))
+		{
+			candidateIndices[index] = static_cast<int>(candidates.size());
+			candidates.emplace_back(section);
+			std::sort(sectionTargets[index].begin(), sectionTargets[index].end(), [](const Target &left, const Target &right)
+			{
+				return left.offset < right.offset;
+			});
+		}
+	}
+
+	// Everything but which candidate a relocation points at has to match
+	// exactly from the start
+	std::vector<uint32_t> classes(candidates.size());
+	{
+		std::map<std::string, uint32_t> classesByKey;
+		for (size_t i = 0; i < candidates.size(); ++i)
+		{
+			const ELFIO::section *section = candidates[i];
+			std::string key;
+			appendFormat(key, "%llu %llu:", static_cast<unsigned long long>(section->get_addr_align()), static_cast<unsigned long long>(section->get_size()));
+			key.append(section->get_data(), section->get_size());
+			for (const auto &target : sectionTargets[section->get_index()])
+			{
+				appendFormat(key, "|%u %u %lld ", target.offset, target.type, static_cast<long long>(target.addend));
+				if (target.symbol >= symbols.size())
+				{
+					appendFormat(key, "?%u", target.symbol);
+					continue;
+				}
+
+				uint16_t targetSection = symbols.getSectionIndex(target.symbol);
+				uint32_t value = symbols.getValue(target.symbol);
+				if (targetSection == 0)
+				{
+					key.append(symbols.getName(target.symbol));
+				}
+				else if (targetSection < sectionCount && candidateIndices[targetSection] != -1)
+				{
+					appendFormat(key, "candidate+%u", value);
+				}
+				else
+				{
+					appendFormat(key, "%u+%u", targetSection, value);
+				}
+			}
+			classes[i] = classesByKey.emplace(std::move(key), static_cast<uint32_t>(classesByKey.size())).first->second;
+		}
+	}
+
+	// Split classes by the classes of the candidates they point at
+	for (size_t classCount = 0; ; )
+	{
+		std::map<std::vector<uint32_t>, uint32_t> classesByKey;
+		std::vector<uint32_t> newClasses(candidates.size());
+		for (size_t i = 0; i < candidates.size(); ++i)
+		{
+			std::vector<uint32_t> key = { classes[i] };
+			for (const auto &target : sectionTargets[candidates[i]->get_index()])
+			{
+				uint16_t targetSection = target.symbol < symbols.size() ? symbols.getSectionIndex(target.symbol) : 0;
+				if (targetSection != 0 && targetSection < sectionCount && candidateIndices[targetSection] != -1)
+				{
+					key.emplace_back(classes[candidateIndices[targetSection]]);
+				}
+			}
+			newClasses[i] = classesByKey.emplace(std::move(key), static_cast<uint32_t>(classesByKey.size())).first->second;
+		}
+
+		classes = std::move(newClasses);
+		if (classesByKey.size() == classCount)
+		{
+			break;
+		}
+		classCount = classesByKey.size();
+	}
+
+	std::vector<uint32_t> foldedInto(sectionCount, 0);
+	std::map<uint32_t, uint32_t> keptSections;
+	for (size_t i = 0; i < candidates.size(); ++i)
+	{
+		auto kept = keptSections.emplace(classes[i], candidates[i]->get_index());
+		if (!kept.second)
+		{
+			foldedInto[candidates[i]->get_index()] = kept.first->second;
+		}
+	}
+	return foldedInto;
+}
+
+// DOL function that calls from the REL branch to through a stub in .text
+struct BranchStub
+{
+	uint32_t symbol = 0;
+	uint32_t address = 0;
+	size_t callCount = 0;
+};
+
+// Finds the DOL functions the given sections call from at least minCalls
+// places, in order of their first call. Only plain calls are counted, ones
+// with an addend keep their own relocation.
+std::vector<BranchStub> findBranchStubTargets(const InputElf &input,
+											  const ExternalSymbols &externalSymbols,
+											  const std::vector<bool> &writtenSections,
+											  int minCalls)
+{
+	const ELFIO::elfio &inputElf = input.elf;
+	const SymbolIndex &symbols = *input.symbols;
+
+	std::vector<size_t> callCounts(symbols.size(), 0);
+	std::vector<uint32_t> calledSymbols;
+	for (const auto &section : input.relocationSections)
+	{
+		uint32_t relocatedSectionIndex = section->get_info();
+		if (relocatedSectionIndex >= writtenSections.size() || !writtenSections[relocatedSectionIndex])
+		{
+			continue;
+		}
+
+		ELFIO::relocation_section_accessor relocations(inputElf, section);
+		for (ELFIO::Elf_Xword i = 0; i < relocations.get_entries_num(); ++i)
+		{
+			ELFIO::Elf64_Addr offset = 0;
+			ELFIO::Elf_Word symbol = 0;
+			ELFIO::Elf_Word type = R_PPC_NONE;
+			ELFIO::Elf_Sxword addend = 0;
+			relocations.get_entry(i, offset, symbol, type, addend);
+			if (type != R_PPC_REL24 || addend != 0 || symbol >= symbols.size() || symbols.getSectionIndex(symbol) != 0)
+			{
+				continue;
+			}
+
+			if (callCounts[symbol]++ == 0)
+			{
+				calledSymbols.emplace_back(symbol);
+			}
+		}
+	}
+
+	std::vector<BranchStub> stubs;
+	for (uint32_t symbol : calledSymbols)
+	{
+		uint32_t address;
+		if (callCounts[symbol] >= static_cast<size_t>(minCalls) && externalSymbols.find(symbols.getName(symbol), address))
+		{
+			stubs.push_back({ symbol, address, callCounts[symbol] });
+		}
+	}
+	return stubs;
+}
+
+// Converts a loaded ELF to a REL and writes it out. Diagnostics are appended
+// to log instead of printed so that batch runs can keep them apart.
+int convertElf(const InputElf &input,
+			   const ExternalSymbols &externalSymbols,
+			   const ConversionJob &job,
+			   int jobCount,
+			   PhaseTimer &timer,
+			   ConversionStats &stats,
+			   std::string &log)
+{
+	const ELFIO::elfio &inputElf = input.elf;
+	const SymbolIndex &symbols = *input.symbols;
+	int moduleID = job.moduleID;
+	int relVersion = job.relVersion;
+
+	std::vector<ProfileEntry> profile;
+	if (job.profileFilename != "")
+	{
+		auto profilePhase = timer.measure("profile_load", job.relFilename);
+		if (!loadFunctionProfile(job.profileFilename, profile, log))
+		{
+			return 1;
+		}
+	}
+
+	uint64_t inputHash = 0;
+	if (job.incremental)
+	{
+		auto hashPhase = timer.measure("input_hash", job.relFilename);
+		inputHash = hashConversionInputs(input, externalSymbols, profile, job);
+		if (isOutputCurrent(job, inputHash, log))
+		{
+			stats.upToDate = true;
+			return 0;
+		}
+
+		// Drop the old hash first, a failed write must not look current
+		std::remove(getHashFilename(job).c_str());
+	}
+
+	// Dead sections are left out of the layout altogether
+	std::vector<bool> liveSections;
+	if (job.gcSections)
+	{
+		auto gcPhase = timer.measure("gc_sections", job.relFilename);
+		liveSections = findLiveSections(input, job.rootSymbols, log);
+	}
+
+	auto sectionCopyPhase = timer.measure("section_copy", job.relFilename);
+
+	// Reserve enough for the whole image up front: header, section table,
+	// section data with worst case padding and a bit over one relocation
+	// entry per ELF relocation
+	size_t estimatedSize = getModuleHeaderSize(relVersion) + cPrelinkInfoSize + cRelSectionCount * 8 + 8;
+	for (const auto &section : inputElf.sections)
+	{
+		if (section->get_type() == SHT_RELA)
+		{
+			size_t entrySize = section->get_entry_size() ? section->get_entry_size() : 12;
+			estimatedSize += section->get_size() / entrySize * 8 + 8 * 3;
+		}
+		else if (section->get_type() != SHT_NOBITS && (section->get_flags() & SHF_ALLOC))
+		{
+			estimatedSize += section->get_size() + section->get_addr_align();
+		}
+	}
+
+	RelWriter outputBuffer;
+	outputBuffer.reserve(estimatedSize);
+
+	// Header is filled in at the end once all offsets are known
+	outputBuffer.putPadding(getModuleHeaderSize(relVersion));
+	int prelinkInfoOffset = outputBuffer.size();
+	if (job.prelinkBase)
+	{
+		outputBuffer.putPadding(cPrelinkInfoSize);
+	}
+	// Section table, entries of empty sections stay zeroed
+	int sectionInfoOffset = outputBuffer.size();
+	outputBuffer.putPadding(cRelSectionCount * 8);
+
+	// Sort the kept input sections into the REL sections, keeping ELF order
+	std::vector<std::vector<const ELFIO::section *>> mergedSections(cRelSectionCount);
+	for (const auto &section : inputElf.sections)
+	{
+		int relSectionIndex = getRelSectionIndex(section);
+		if (relSectionIndex == 0)
+		{
+			continue;
+		}
+
+		if (!liveSections.empty() && !liveSections[section->get_index()])
+		{
+			++stats.deadSectionCount;
+			if (relSectionIndex == cRelBssSection)
+			{
+				stats.deadBssSize += section->get_size();
+			}
+			else
+			{
+				stats.deadSectionSize += section->get_size();
+			}
+			continue;
+		}
+		mergedSections[relSectionIndex].emplace_back(section);
+	}
+	if (!profile.empty())
+	{
+		orderSectionsByProfile(mergedSections[cRelTextSection], symbols, profile, stats);
+	}
+
+	// Identical functions are only written once, the first of them in .text
+	// order stands in for the others
+	std::vector<uint32_t> foldedInto;
+	if (job.foldIdenticalCode || job.foldAddressTaken)
+	{
+		auto &textSections = mergedSections[cRelTextSection];
+		foldedInto = findIdenticalSections(input, textSections, job.foldAddressTaken);
+		textSections.erase(std::remove_if(textSections.begin(), textSections.end(), [&](const ELFIO::section *section)
+		{
+			if (foldedInto[section->get_index()] == 0)
+			{
+				return false;
+			}
+			++stats.foldedSectionCount;
+			stats.foldedSize += section->get_size();
+			return true;
+		}), textSections.end());
+	}
+
+	// Identical constants and strings are only written once
+	std::vector<MergedBlock> mergedBlocks;
+	std::map<uint32_t, MergedInput> mergedInputs;
+	if (job.mergeConstants)
+	{
+		std::vector<bool> relocatedSections(inputElf.sections.size(), false);
+		for (const auto &section : input.relocationSections)
+		{
+			if (section->get_info() < relocatedSections.size())
+			{
+				relocatedSections[section->get_info()] = true;
+			}
+		}
+		for (int relSectionIndex = 1; relSectionIndex < cRelBssSection; ++relSectionIndex)
+		{
+			const std::string &relSectionName = cRelSectionMask[relSectionIndex - 1];
+			if (relSectionName != ".init" && relSectionName != ".text" && relSectionName != ".ctors" && relSectionName != ".dtors")
+			{
+				mergeConstants(mergedSections[relSectionIndex], relocatedSections, mergedBlocks, mergedInputs, stats);
+			}
+		}
+	}
+
+	// Often called DOL functions are called through a branch at the end of
+	// .text, which is relocated against the DOL once instead of every call
+	std::vector<BranchStub> branchStubs;
+	std::vector<int> branchStubIndices;
+	std::vector<char> branchStubCode;
+	uint32_t branchStubOffset = 0;
+	if (job.branchStubMinCalls > 0)
+	{
+		std::vector<bool> writtenSections(inputElf.sections.size(), false);
+		for (const auto &sections : mergedSections)
+		{
+			for (const auto &section : sections)
+			{
+				writtenSections[section->get_index()] = true;
+			}
+		}
+
+		// A stub for a single call only adds code
+		branchStubs = findBranchStubTargets(input, externalSymbols, writtenSections, std::max(job.branchStubMinCalls, 2));
+		branchStubIndices.assign(symbols.size(), -1);
+		for (size_t i = 0; i < branchStubs.size(); ++i)
+		{
+			branchStubIndices[branchStubs[i].symbol] = static_cast<int>(i);
+			// b 0, the target is filled in by the relocation
+			branchStubCode.insert(branchStubCode.end(), { 0x48, 0x00, 0x00, 0x00 });
+			++stats.branchStubCount;
+			stats.branchStubCallCount += branchStubs[i].callCount;
+		}
+	}
+
+	// Write sections. Every input section keeps its own alignment within the
+	// REL section, which is aligned to the largest of them.
+	struct SectionPlacement
+	{
+		int relSection = 0; // 0 if not written
+		uint32_t offset = 0;
+		const MergedInput *merged = nullptr;
+	};
+	std::vector<SectionPlacement> sectionPlacements(inputElf.sections.size());
+	// Offset within the REL section of an offset into an input section
+	auto getPlacedOffset = [](const SectionPlacement &placement, uint32_t offset)
+	{
+		return placement.offset + (placement.merged ? getMergedOffset(*placement.merged, offset) : offset);
+	};
+	std::vector<int> writtenSectionOffsets(cRelSectionCount, -1);
+	int totalBssSize = 0;
+	int maxAlign = 2;
+	int maxBssAlign = 2;
+	for (int relSectionIndex = 1; relSectionIndex < cRelSectionCount; ++relSectionIndex)
+	{
+		if (mergedSections[relSectionIndex].empty() && (relSectionIndex != cRelTextSection || branchStubCode.empty()))
+		{
+			continue;
+		}
+
+		// Merged sections are written as their block
+		std::vector<SectionPiece> sections;
+		int sectionAlign = 1;
+		for (const auto &section : mergedSections[relSectionIndex])
+		{
+			SectionPiece &piece = sections.emplace_back();
+			piece.section = section;
+			auto merged = mergedInputs.find(section->get_index());
+			if (merged != mergedInputs.end())
+			{
+				const MergedBlock &block = mergedBlocks[merged->second.block];
+				piece.data = block.data.data();
+				piece.size = static_cast<uint32_t>(block.data.size());
+				piece.align = block.align;
+			}
+			else
+			{
+				piece.data = section->get_data();
+				piece.size = static_cast<uint32_t>(section->get_size());
+				piece.align = std::max(static_cast<uint32_t>(section->get_addr_align()), 1u);
+			}
+			sectionAlign = std::max(sectionAlign, static_cast<int>(piece.align));
+		}
+		if (relSectionIndex == cRelTextSection && !branchStubCode.empty())
+		{
+			SectionPiece &piece = sections.emplace_back();
+			piece.data = branchStubCode.data();
+			piece.size = static_cast<uint32_t>(branchStubCode.size());
+			piece.align = 4;
+			sectionAlign = std::max(sectionAlign, 4);
+		}
+
+		// Lay out the pieces. Startup code and the constructor and destructor
+		// tables depend on their order, they are never packed. Neither is
+		// .text once the profile ordered it.
+		const std::string &relSectionName = cRelSectionMask[relSectionIndex - 1];
+		std::vector<uint32_t> offsets;
+		uint32_t relSectionSize = layoutSectionsInOrder(sections, offsets);
+		if (job.packSections
+			&& relSectionName != ".init" && relSectionName != ".ctors" && relSectionName != ".dtors"
+			&& (relSectionIndex != cRelTextSection || profile.empty()))
+		{
+			// Sorting by alignment is a heuristic, keep ELF order if it doesn't help
+			std::vector<uint32_t> packedOffsets;
+			uint32_t packedSize = layoutSectionsPacked(sections, packedOffsets);
+			if (packedSize < relSectionSize)
+			{
+				(relSectionIndex == cRelBssSection ? stats.packedBssSaving : stats.packedSaving) += relSectionSize - packedSize;
+				relSectionSize = packedSize;
+				offsets = std::move(packedOffsets);
+			}
+		}
+		for (size_t i = 0; i < sections.size(); ++i)
+		{
+			if (!sections[i].section)
+			{
+				branchStubOffset = offsets[i];
+				continue;
+			}
+
+			auto merged = mergedInputs.find(sections[i].section->get_index());
+			if (merged == mergedInputs.end())
+			{
+				sectionPlacements[sections[i].section->get_index()] = { relSectionIndex, offsets[i] };
+				continue;
+			}
+			for (uint32_t sectionIndex : mergedBlocks[merged->second.block].sectionIndices)
+			{
+				sectionPlacements[sectionIndex] = { relSectionIndex, offsets[i], &mergedInputs.at(sectionIndex) };
+			}
+		}
+
+		// BSS?
+		if (relSectionIndex == cRelBssSection)
+		{
+			// Update max alignment
+			maxBssAlign = std::max(maxBssAlign, sectionAlign);
+
+			totalBssSize = static_cast<int>(relSectionSize);
+			writeSectionInfo(outputBuffer, sectionInfoOffset, relSectionIndex, 0, totalBssSize);
+			continue;
+		}
+
+		// Update max alignment (minimum 2, low offset bit is used for exec flag)
+		sectionAlign = std::max(sectionAlign, 2);
+		maxAlign = std::max(maxAlign, sectionAlign);
+
+		// Write padding
+		size_t unpaddedSize = outputBuffer.size();
+		outputBuffer.alignTo(sectionAlign);
+		stats.paddingSize += outputBuffer.size() - unpaddedSize;
+
+		// Write the pieces in address order, padding up to each one
+		std::vector<size_t> writeOrder(sections.size());
+		for (size_t i = 0; i < writeOrder.size(); ++i)
+		{
+			writeOrder[i] = i;
+		}
+		std::sort(writeOrder.begin(), writeOrder.end(), [&](size_t left, size_t right)
+		{
+			return offsets[left] < offsets[right];
+		});
+
+		int offset = outputBuffer.size();
+		bool isExecutable = false;
+		for (size_t i : writeOrder)
+		{
+			const SectionPiece &piece = sections[i];
+			stats.paddingSize += offset + offsets[i] - outputBuffer.size();
+			outputBuffer.putPadding(offset + offsets[i] - outputBuffer.size());
+			outputBuffer.putBytes(piece.data, piece.size);
+			isExecutable |= !piece.section || (piece.section->get_flags() & SHF_EXECINSTR) != 0;
+		}
+		outputBuffer.putPadding(offset + relSectionSize - outputBuffer.size());
+
+		int encodedOffset = offset;
+		// Mark executable sections
+		if (isExecutable)
+		{
+			encodedOffset |= 1;
+		}
+		writeSectionInfo(outputBuffer, sectionInfoOffset, relSectionIndex, encodedOffset, static_cast<int>(outputBuffer.size() - offset));
+
+		writtenSectionOffsets[relSectionIndex] = offset;
+	}
+
+	for (size_t i = 0; i < foldedInto.size(); ++i)
+	{
+		if (foldedInto[i] != 0)
+		{
+			sectionPlacements[i] = sectionPlacements[foldedInto[i]];
+		}
+	}
+
+	// Find prolog, epilog and unresolved
+	auto findSymbolSectionAndOffset = [&](std::string_view name, int &sectionIndex, int &offset)
+	{
+		uint32_t index = symbols.find(name);
+		if (index != SymbolIndex::cInvalidIndex
+			&& symbols.getSectionIndex(index) < sectionPlacements.size()
+			&& sectionPlacements[symbols.getSectionIndex(index)].relSection != 0)
+		{
+			const SectionPlacement &placement = sectionPlacements[symbols.getSectionIndex(index)];
+			sectionIndex = placement.relSection;
+			offset = static_cast<int>(getPlacedOffset(placement, symbols.getValue(index)));
+		}
+	};
+
+	int prologSectionIndex = 0, prologOffset = 0;
+	findSymbolSectionAndOffset("_prolog", prologSectionIndex, prologOffset);
+	int epilogSectionIndex = 0, epilogOffset = 0;
+	findSymbolSectionAndOffset("_epilog", epilogSectionIndex, epilogOffset);
+	int unresolvedSectionIndex = 0, unresolvedOffset = 0;
+	findSymbolSectionAndOffset("_unresolved", unresolvedSectionIndex, unresolvedOffset);
+
+	sectionCopyPhase.finish();
+	auto collectionPhase = timer.measure("relocation_collection", job.relFilename);
+
+	// Group relocation sections by the REL section they relocate. Only
+	// sections that were written get relocated, folded ones share the
+	// relocations of the section they were folded into.
+	std::vector<ELFIO::section *> activeRelocationSections;
+	std::map<uint32_t, std::vector<ELFIO::section *>> relocationSectionsByTarget;
+	for (const auto &section : input.relocationSections)
+	{
+		uint32_t relocatedSectionIndex = section->get_info();
+		if (relocatedSectionIndex < sectionPlacements.size()
+			&& sectionPlacements[relocatedSectionIndex].relSection != 0
+			&& writtenSectionOffsets[sectionPlacements[relocatedSectionIndex].relSection] != -1
+			&& (foldedInto.empty() || foldedInto[relocatedSectionIndex] == 0))
+		{
+			activeRelocationSections.emplace_back(section);
+			relocationSectionsByTarget[sectionPlacements[relocatedSectionIndex].relSection].emplace_back(section);
+		}
+	}
+
+	// Resolves a single ELF relocation to its target module and REL relocation,
+	// with offsets rebased to the REL sections. Returns false if the
+	// relocation is dropped, unwrittenTarget is set if that left a field
+	// unpatched. Diagnostics go to the caller's log so that parallel runs can
+	// print them in a fixed order.
+	struct Relocation
+	{
+		uint32_t offset;
+		uint32_t addend;
+		uint8_t type;
+		uint8_t targetSection;  // target symbol
+	};
+	auto resolveRelocation = [&](const ELFIO::relocation_section_accessor &relocations,
+								 ELFIO::Elf_Xword entryIndex,
+								 ELFIO::section *relocatedSection,
+								 std::string *log,
+								 bool &invalidSymbol,
+								 bool &unwrittenTarget,
+								 uint32_t &targetModuleID,
+								 Relocation &rel)
+	{
+		ELFIO::Elf64_Addr offset = 0;
+		ELFIO::Elf_Word symbol = 0;
+		ELFIO::Elf_Word type = R_PPC_NONE;
+		ELFIO::Elf_Sxword addend = 0;
+		relocations.get_entry(entryIndex, offset, symbol, type, addend);
+
+		// Ignore R_PPC_NONE
+		if (type == R_PPC_NONE)
+			return false;
+
+		if (symbol >= symbols.size())
+		{
+			if (log)
+			{
+				appendFormat(*log, "Unable to find symbol %u in symbol table!\n", static_cast<uint32_t>(symbol));
+			}
+			invalidSymbol = true;
+			return false;
+		}
+		std::string_view symbolName = symbols.getName(symbol);
+		uint32_t symbolValue = symbols.getValue(symbol);
+		uint16_t sectionIndex = symbols.getSectionIndex(symbol);
+
+		rel.offset = sectionPlacements[relocatedSection->get_index()].offset + static_cast<uint32_t>(offset);
+		rel.type = type;
+		if (sectionIndex == SHN_ABS)
+		{
+			// Absolute symbols don't move with the REL
+			targetModuleID = 0;
+			rel.targetSection = 0;
+			rel.addend = static_cast<uint32_t>(addend + symbolValue);
+			return true;
+		}
+		if (sectionIndex)
+		{
+			if (sectionIndex >= sectionPlacements.size() || sectionPlacements[sectionIndex].relSection == 0)
+			{
+				if (log)
+				{
+					appendFormat(*log, "Relocation from section '%s' offset %llx against symbol '%.*s' in unwritten section '%s'\n",
+								 relocatedSection->get_name().c_str(),
+								 static_cast<unsigned long long>(offset),
+								 static_cast<int>(symbolName.size()), symbolName.data(),
+								 sectionIndex < inputElf.sections.size() ? inputElf.sections[sectionIndex]->get_name().c_str() : "?");
+				}
+				unwrittenTarget = true;
+				return false;
+			}
+
+			// Self-relocation
+			const SectionPlacement &placement = sectionPlacements[sectionIndex];
+			targetModuleID = moduleID;
+			rel.targetSection = static_cast<uint8_t>(placement.relSection);
+			rel.addend = getPlacedOffset(placement, static_cast<uint32_t>(addend + symbolValue));
+			return true;
+		}
+
+		// Calls through a branch stub stay within the module
+		if (type == R_PPC_REL24 && addend == 0 && !branchStubIndices.empty() && branchStubIndices[symbol] != -1)
+		{
+			targetModuleID = moduleID;
+			rel.targetSection = cRelTextSection;
+			rel.addend = branchStubOffset + branchStubIndices[symbol] * 4;
+			return true;
+		}
+
+		// Symbol is unknown, check if it's an external known symbol
+		uint32_t externalAddress;
+		if (externalSymbols.find(symbolName, externalAddress))
+		{
+			// Known external!
+			targetModuleID = 0;
+			rel.targetSection = 0; // #todo-elf2rel: Check if this is important
+			rel.addend = static_cast<uint32_t>(addend + externalAddress);
+			return true;
+		}
+
+		// Symbols in game RELs are imported from them, OSLink links them
+		// once both are loaded
+		uint32_t externalModuleID, externalSection;
+		if (externalSymbols.findInModule(symbolName, externalModuleID, externalSection, externalAddress))
+		{
+			targetModuleID = externalModuleID;
+			rel.targetSection = static_cast<uint8_t>(externalSection);
+			rel.addend = static_cast<uint32_t>(addend + externalAddress);
+			return true;
+		}
+
+		if (log)
+		{
+			appendFormat(*log, "Unresolved external symbol '%.*s'\n", static_cast<int>(symbolName.size()), symbolName.data());
+		}
+		return false;
+	};
+
+	ThreadPool threadPool(jobCount);
+
+	// First pass only counts relocations per (target module, relocated
+	// section) bucket, nothing is stored yet. Every .rela section is
+	// independent, so they are spread over the pool.
+	struct CountResult
+	{
+		std::map<uint32_t, size_t> moduleCounts;
+		std::string log;
+		bool invalidSymbol = false;
+		bool unwrittenTarget = false;
+	};
+	std::vector<CountResult> countResults(activeRelocationSections.size());
+	threadPool.run(activeRelocationSections.size(), [&](size_t taskIndex, int)
+	{
+		ELFIO::section *section = activeRelocationSections[taskIndex];
+		CountResult &result = countResults[taskIndex];
+
+		ELFIO::relocation_section_accessor relocations(inputElf, section);
+		ELFIO::section *relocatedSection = inputElf.sections[section->get_info()];
+		for (ELFIO::Elf_Xword i = 0; i < relocations.get_entries_num() && !result.invalidSymbol; ++i)
+		{
+			uint32_t targetModuleID;
+			Relocation rel;
+			if (resolveRelocation(relocations, i, relocatedSection, &result.log, result.invalidSymbol, result.unwrittenTarget, targetModuleID, rel))
+			{
+				++result.moduleCounts[targetModuleID];
+			}
+		}
+	});
+
+	// Merge in section order
+	std::map<uint32_t, std::map<uint32_t, size_t>> bucketSizes;
+	bool hasUnwrittenTarget = false;
+	for (size_t i = 0; i < activeRelocationSections.size(); ++i)
+	{
+		const CountResult &result = countResults[i];
+		log += result.log;
+		if (result.invalidSymbol)
+		{
+			return 1;
+		}
+		hasUnwrittenTarget |= result.unwrittenTarget;
+
+		for (const auto &moduleCount : result.moduleCounts)
+		{
+			bucketSizes[moduleCount.first][sectionPlacements[activeRelocationSections[i]->get_info()].relSection] += moduleCount.second;
+		}
+	}
+	countResults.clear();
+
+	// The field would keep whatever the compiler left in it
+	if (hasUnwrittenTarget)
+	{
+		return 1;
+	}
+
+	// The branch stubs themselves are relocated against the DOL
+	if (!branchStubs.empty())
+	{
+		bucketSizes[0][cRelTextSection] += branchStubs.size();
+	}
+
+	collectionPhase.finish();
+	// Bucket filling happens in the same tasks as sorting, so it's counted here
+	auto encodePhase = timer.measure("sort_encode", job.relFilename);
+
+	// Write padding for imports
+	stats.sectionDataSize = outputBuffer.size() - (sectionInfoOffset + cRelSectionCount * 8);
+	stats.paddingSize += 8 - outputBuffer.size() % 8;
+	outputBuffer.putPadding(8 - outputBuffer.size() % 8);
+
+	// Second pass fills and encodes the buckets, in (module, section, offset)
+	// order within each. Every bucket is encoded into its own buffer, the
+	// buffers are appended in order below. Early resolution patches the
+	// relocated section in place. That is safe to do in parallel: no two
+	// buckets of the same module share a relocated section, and buckets of
+	// different modules never patch the same bytes.
+	struct BucketTask
+	{
+		uint32_t moduleID;
+		uint32_t sectionIndex;
+		size_t size;
+		RelWriter encoded;
+		std::string log;
+		size_t earlyResolvedCount = 0;
+		size_t dolResolvedCount = 0;
+		bool outOfRange = false;
+		bool unwrittenTarget = false;
+	};
+	std::vector<BucketTask> bucketTasks;
+	for (const auto &moduleBuckets : bucketSizes)
+	{
+		for (const auto &sectionBucket : moduleBuckets.second)
+		{
+			BucketTask task;
+			task.moduleID = moduleBuckets.first;
+			task.sectionIndex = sectionBucket.first;
+			task.size = sectionBucket.second;
+			bucketTasks.emplace_back(std::move(task));
+		}
+	}
+	// Imports from game RELs go first, so that a prelinked REL can leave
+	// just those to OSLink
+	auto isGameModule = [&](uint32_t importModuleID)
+	{
+		return importModuleID != 0 && importModuleID != static_cast<uint32_t>(moduleID);
+	};
+	std::stable_partition(bucketTasks.begin(), bucketTasks.end(), [&](const BucketTask &task)
+	{
+		return isGameModule(task.moduleID);
+	});
+
+	// Scratch buffer per worker, so at most one bucket per thread is held
+	std::vector<std::vector<Relocation>> workerBuckets(threadPool.getThreadCount());
+	threadPool.run(bucketTasks.size(), [&](size_t taskIndex, int workerIndex)
+	{
+		BucketTask &task = bucketTasks[taskIndex];
+		std::vector<Relocation> &bucket = workerBuckets[workerIndex];
+		const std::string &relSectionName = cRelSectionMask[task.sectionIndex - 1];
+
+		// Fill the bucket. Every .rela section is almost always already in
+		// offset order, so each one forms a sorted run that gets merged in.
+		auto byOffset = [](const Relocation &left, const Relocation &right)
+		{
+			return left.offset < right.offset;
+		};
+		bucket.clear();
+		bucket.reserve(task.size);
+		for (const auto &section : relocationSectionsByTarget[task.sectionIndex])
+		{
+			size_t runStart = bucket.size();
+			ELFIO::relocation_section_accessor relocations(inputElf, section);
+			ELFIO::section *relocatedSection = inputElf.sections[section->get_info()];
+			for (ELFIO::Elf_Xword i = 0; i < relocations.get_entries_num(); ++i)
+			{
+				bool invalidSymbol = false;
+				bool unwrittenTarget = false;
+				uint32_t targetModuleID;
+				Relocation rel;
+				if (resolveRelocation(relocations, i, relocatedSection, nullptr, invalidSymbol, unwrittenTarget, targetModuleID, rel)
+					&& targetModuleID == task.moduleID)
+				{
+					bucket.emplace_back(rel);
+				}
+			}
+
+			if (!std::is_sorted(bucket.begin() + runStart, bucket.end(), byOffset))
+			{
+				std::stable_sort(bucket.begin() + runStart, bucket.end(), byOffset);
+			}
+			std::inplace_merge(bucket.begin(), bucket.begin() + runStart, bucket.end(), byOffset);
+		}
+		if (task.moduleID == 0 && task.sectionIndex == cRelTextSection && !branchStubs.empty())
+		{
+			size_t runStart = bucket.size();
+			for (size_t i = 0; i < branchStubs.size(); ++i)
+			{
+				bucket.push_back({ branchStubOffset + static_cast<uint32_t>(i) * 4, branchStubs[i].address, R_PPC_REL24, 0 });
+			}
+			std::inplace_merge(bucket.begin(), bucket.begin() + runStart, bucket.end(), byOffset);
+		}
+
+		// Encode the bucket
+		int writtenOffset = writtenSectionOffsets[task.sectionIndex];
+		int currentOffset = 0;
+		for (const auto &nextRel : bucket)
+		{
+			// The DOL never moves, so absolute relocations against it are final
+			if (task.moduleID == 0
+				&& !job.keepDolRelocations
+				&& applyAbsoluteRelocation(outputBuffer, writtenOffset + nextRel.offset, nextRel.type, nextRel.addend))
+			{
+				++task.dolResolvedCount;
+				continue;
+			}
+
+			// Relative relocations within the module don't depend on where it's
+			// loaded, they are all resolved here
+			if (task.moduleID == static_cast<uint32_t>(moduleID)
+				&& (nextRel.type == R_PPC_REL24 || nextRel.type == R_PPC_REL14 || nextRel.type == R_PPC_REL14_BRTAKEN
+					|| nextRel.type == R_PPC_REL14_BRNKTAKEN || nextRel.type == R_PPC_REL32))
+			{
+				int targetOffset = writtenSectionOffsets[nextRel.targetSection];
+				if (targetOffset == -1)
+				{
+					appendFormat(task.log, "Branch from section '%s' offset %x into unwritten section '%s'\n",
+								 relSectionName.c_str(),
+								 nextRel.offset,
+								 cRelSectionMask[nextRel.targetSection - 1].c_str());
+					task.unwrittenTarget = true;
+					continue;
+				}
+
+				int offset = writtenOffset + nextRel.offset;
+				int32_t delta = targetOffset + static_cast<int32_t>(nextRel.addend) - offset;
+				if (!fitsRelativeRelocation(nextRel.type, delta))
+				{
+					appendFormat(task.log, "%s from section '%s' offset %x to section '%s' offset %x out of range, displacement %s0x%x\n",
+								 getRelocationTypeName(nextRel.type),
+								 relSectionName.c_str(),
+								 nextRel.offset,
+								 cRelSectionMask[nextRel.targetSection - 1].c_str(),
+								 nextRel.addend,
+								 delta < 0 ? "-" : "",
+								 static_cast<uint32_t>(delta < 0 ? -static_cast<int64_t>(delta) : delta));
+					task.outOfRange = true;
+					continue;
+				}
+
+				applyRelativeRelocation(outputBuffer, offset, nextRel.type, targetOffset + nextRel.addend, offset);
+				++task.earlyResolvedCount;
+
+				continue;
+			}
+
+			// Start the section
+			if (task.encoded.size() == 0)
+			{
+				writeRelocation(task.encoded, 0, R_DOLPHIN_SECTION, task.sectionIndex, 0);
+			}
+
+			// Get into range of the target
+			int targetDelta = nextRel.offset - currentOffset;
+			while (targetDelta > 0xFFFF)
+			{
+				writeRelocation(task.encoded, 0xFFFF, R_DOLPHIN_NOP, 0, 0);
+				targetDelta -= 0xFFFF;
+			}
+
+			// #todo-elf2rel: Add runtime unresolved symbol handling here
+			// At this point, only symbols that OSLink can handle should remain
+			switch (nextRel.type)
+			{
+			case R_PPC_NONE:
+			case R_PPC_ADDR32:
+			case R_PPC_ADDR24:
+			case R_PPC_ADDR16:
+			case R_PPC_ADDR16_LO:
+			case R_PPC_ADDR16_HI:
+			case R_PPC_ADDR16_HA:
+			case R_PPC_ADDR14:
+			case R_PPC_ADDR14_BRTAKEN:
+			case R_PPC_ADDR14_BRNKTAKEN:
+			case R_PPC_REL24:
+			case R_DOLPHIN_NOP:
+			case R_DOLPHIN_SECTION:
+			case R_DOLPHIN_END:
+				break;
+			default:
+				appendFormat(task.log, "Unsupported relocation type %d\n", nextRel.type);
+				break;
+			}
+
+			writeRelocation(task.encoded, targetDelta, nextRel.type, nextRel.targetSection, nextRel.addend);
+			currentOffset = nextRel.offset;
+		}
+	});
+	workerBuckets.clear();
+
+	// Only modules with relocations left after build time resolution get an
+	// import, the DOL's may be gone entirely
+	int importCount = 0;
+	uint32_t previousModuleID = 0;
+	for (const auto &task : bucketTasks)
+	{
+		if (task.encoded.size() != 0 && (importCount == 0 || previousModuleID != task.moduleID))
+		{
+			previousModuleID = task.moduleID;
+			++importCount;
+		}
+	}
+
+	// Imports are filled in as their relocations are written
+	int importInfoOffset = outputBuffer.size();
+	outputBuffer.putPadding(importCount * 8);
+
+	// Write out relocations
+	int relocationOffset = outputBuffer.size();
+
+	// Merge the encoded buckets, starting a new import whenever the module
+	// changes
+	int importIndex = 0;
+	int gameImportCount = 0;
+	uint32_t currentModuleID = 0;
+	for (auto &task : bucketTasks)
+	{
+		log += task.log;
+		stats.earlyResolvedCount += task.earlyResolvedCount;
+		stats.dolResolvedCount += task.dolResolvedCount;
+		if (task.encoded.size() == 0)
+		{
+			continue;
+		}
+
+		for (size_t i = 0; i < task.encoded.size(); i += 8)
+		{
+			int type = task.encoded.readAt<uint8_t>(i + 2);
+			if (type == R_DOLPHIN_NOP)
+			{
+				++stats.nopCount;
+			}
+			else if (type != R_DOLPHIN_SECTION)
+			{
+				++stats.relocationCounts[type];
+				++stats.moduleRelocationCounts[task.moduleID];
+			}
+		}
+
+		// Change module if necessary
+		if (importIndex == 0 || currentModuleID != task.moduleID)
+		{
+			// Not first module?
+			if (importIndex != 0)
+			{
+				writeRelocation(outputBuffer, 0, R_DOLPHIN_END, 0, 0);
+			}
+
+			currentModuleID = task.moduleID;
+			writeImportInfo(outputBuffer, importInfoOffset, importIndex++, currentModuleID, outputBuffer.size());
+			if (isGameModule(currentModuleID))
+			{
+				++gameImportCount;
+			}
+		}
+
+		outputBuffer.putBytes(task.encoded.data(), task.encoded.size());
+		task.encoded = RelWriter();
+	}
+	writeRelocation(outputBuffer, 0, R_DOLPHIN_END, 0, 0);
+
+	// A truncated or unpatched displacement would branch somewhere else entirely
+	if (std::any_of(bucketTasks.begin(), bucketTasks.end(), [](const BucketTask &task)
+	{
+		return task.outOfRange || task.unwrittenTarget;
+	}))
+	{
+		return 1;
+	}
+
+	// Write final import infos
+	int importInfoSize = importIndex * 8;
+
+	stats.bssSize = totalBssSize;
+	stats.importTableSize = importInfoSize;
+	stats.relocationTableSize = outputBuffer.size() - relocationOffset;
+	stats.totalSize = outputBuffer.size();
+
+	encodePhase.finish();
+
+	// The relocations stay in the file in case the REL doesn't end up at the
+	// expected address, but the header hides all but the imports from game
+	// RELs from OSLink
+	int headerImportInfoSize = importInfoSize;
+	if (job.prelinkBase)
+	{
+		auto prelinkPhase = timer.measure("prelink", job.relFilename);
+
+		// The loader allocates bss right after the REL, rounded up to card blocks
+		uint32_t bssBase = job.prelinkBssBase;
+		if (bssBase == 0)
+		{
+			bssBase = job.prelinkBase + ((static_cast<uint32_t>(outputBuffer.size()) + 0x1FF) & ~0x1FFu);
+		}
+
+		if (!prelinkRelocations(outputBuffer,
+								moduleID,
+								sectionInfoOffset,
+								cRelSectionCount,
+								importInfoOffset,
+								importInfoSize,
+								job.prelinkBase,
+								bssBase,
+								stats.prelinkedCount,
+								log))
+		{
+			return 1;
+		}
+
+		writePrelinkInfo(outputBuffer, prelinkInfoOffset, job.prelinkBase, bssBase, importInfoSize);
+		headerImportInfoSize = gameImportCount * 8;
+		stats.prelinkBase = job.prelinkBase;
+		stats.prelinkBssBase = bssBase;
+	}
+
+	auto writePhase = timer.measure("write", job.relFilename);
+
+	// Write final header
+	writeModuleHeader(outputBuffer,
+					  relVersion,
+					  moduleID,
+					  cRelSectionCount,
+					  sectionInfoOffset,
+					  totalBssSize,
+					  relocationOffset,
+					  importInfoOffset,
+					  headerImportInfoSize,
+					  prologSectionIndex, epilogSectionIndex, unresolvedSectionIndex,
+					  prologOffset, epilogOffset, unresolvedOffset,
+					  maxAlign,
+					  maxBssAlign,
+					  relocationOffset);
+
+	// Write final REL file
+	if (!outputBuffer.writeToFile(job.relFilename))
+	{
+		appendFormat(log, "Failed to write output file '%s'\n", job.relFilename.c_str());
+		return 1;
+	}
+
+	// Other modules import global symbols through the map like through the
+	// symbol map of a game REL, the offsets are final
+	if (job.writeExportMap)
+	{
+		std::string exportMap;
+		appendFormat(exportMap, "// Exports of module %d, <section>,<offset>:<name>\n", moduleID);
+		for (uint32_t i = 0; i < symbols.size(); ++i)
+		{
+			uint16_t sectionIndex = symbols.getSectionIndex(i);
+			std::string_view name = symbols.getName(i);
+			if ((symbols.getBind(i) != STB_GLOBAL && symbols.getBind(i) != STB_WEAK)
+				|| name.empty()
+				|| sectionIndex >= sectionPlacements.size()
+				|| sectionPlacements[sectionIndex].relSection == 0)
+			{
+				continue;
+			}
+
+			const SectionPlacement &placement = sectionPlacements[sectionIndex];
+			appendFormat(exportMap, "%d,%08X:%.*s\n",
+						 placement.relSection,
+						 getPlacedOffset(placement, symbols.getValue(i)),
+						 static_cast<int>(name.size()), name.data());
+			++stats.exportedSymbolCount;
+		}
+
+		std::ofstream outputStream(getExportMapFilename(job), std::ios::binary);
+		if (!(outputStream << exportMap))
+		{
+			appendFormat(log, "Failed to write export map '%s'\n", getExportMapFilename(job).c_str());
+			return 1;
+		}
+	}
+
+	if (job.incremental)
+	{
+		std::ofstream outputStream(getHashFilename(job), std::ios::binary);
+		outputStream << std::hex << inputHash << std::dec << " " << outputBuffer.size() << "\n" << log;
+	}
+
+	return 0;
+}
+
+// Parses a '<module id>=<lst>' symbol map of a game REL. Module 0 is the
+// DOL, which is what the main symbol file is for.
+bool parseModuleLst(const std::string &argument, std::pair<uint32_t, std::string> &moduleLst)
+{
+	size_t separator = argument.find('=');
+	if (separator == std::string::npos || separator == 0 || separator + 1 == argument.size())
+	{
+		return false;
+	}
+
+	moduleLst.first = strtoul(argument.substr(0, separator).c_str(), nullptr, 0);
+	moduleLst.second = argument.substr(separator + 1);
+	return moduleLst.first != 0;
+}
+
+// Reads a batch manifest. Every line describes one conversion as
+// whitespace separated fields: ELF file, symbol file, output REL file and
+// optionally the REL ID and version, which otherwise default to the values
+// given on the command line. Symbol maps of game RELs can follow as
+// <module id>=<lst>, they are looked in before the ones given on the
+// command line. Blank lines and // comments are ignored.
+bool loadBatchManifest(const std::string &filename, const ConversionJob &defaults, std::vector<ConversionJob> &jobs)
+{
+	std::ifstream inputStream(filename);
+	if (!inputStream)
+	{
+		printf("Failed to open batch manifest '%s'\n", filename.c_str());
+		return false;
+	}
+
+	int lineNumber = 0;
+	for (std::string line; std::getline(inputStream, line); )
+	{
+		++lineNumber;
+
+		// Ignore comments
+		size_t commentStart = line.find("//");
+		if (commentStart != std::string::npos)
+		{
+			line.erase(commentStart);
+		}
+		boost::trim(line);
+		if (line.empty())
+		{
+			continue;
+		}
+
+		std::vector<std::string> fields;
+		boost::split(fields, line, boost::is_any_of(" \t"), boost::token_compress_on);
+
+		// Game REL symbol maps come last, they are told apart by the '='
+		ConversionJob job = defaults;
+		while (fields.size() > 3 && fields.back().find('=') != std::string::npos)
+		{
+			std::pair<uint32_t, std::string> moduleLst;
+			if (!parseModuleLst(fields.back(), moduleLst))
+			{
+				printf("%s:%d: Expected <module id>=<lst>, got '%s'\n", filename.c_str(), lineNumber, fields.back().c_str());
+				return false;
+			}
+			job.moduleLstFilenames.insert(job.moduleLstFilenames.begin(), moduleLst);
+			fields.pop_back();
+		}
+		if (fields.size() < 3 || fields.size() > 5)
+		{
+			printf("%s:%d: Expected <elf> <lst> <rel> [rel-id] [rel-version] [<module id>=<lst> ...]\n", filename.c_str(), lineNumber);
+			return false;
+		}
+
+		job.elfFilename = fields[0];
+		job.lstFilename = fields[1];
+		job.relFilename = fields[2];
+		if (fields.size() >= 4)
+		{
+			job.moduleID = strtol(fields[3].c_str(), nullptr, 0);
+		}
+		if (fields.size() >= 5)
+		{
+			job.relVersion = strtol(fields[4].c_str(), nullptr, 0);
+		}
+
+		if (job.relVersion < 1 || job.relVersion > 3)
+		{
+			printf("%s:%d: Unsupported REL version %d\n", filename.c_str(), lineNumber, job.relVersion);
+			return false;
+		}
+
+		jobs.emplace_back(std::move(job));
+	}
+
+	return true;
+}
+
+void appendStats(std::string &output,
+				 const ConversionJob &job,
+				 const ConversionStats &stats,
+				 const std::vector<PhaseTimer::Phase> &phases)
+{
+	appendFormat(output, "Statistics for '%s':\n", job.relFilename.c_str());
+	appendFormat(output, "  Phases:\n");
+	for (const auto &phase : phases)
+	{
+		appendFormat(output, "    %-24s %10.3f ms\n", phase.name.c_str(), phase.durationMicroseconds / 1000.0);
+	}
+
+	if (stats.upToDate)
+	{
+		appendFormat(output, "  Up to date, not converted\n");
+		return;
+	}
+
+	size_t relocationCount = 0;
+	for (const auto &count : stats.relocationCounts)
+	{
+		relocationCount += count.second;
 	}
-	if (version >= 3)
+	appendFormat(output, "  Relocations: %zu, %zu more resolved early, %zu more applied against the DOL\n",
+				 relocationCount, stats.earlyResolvedCount, stats.dolResolvedCount);
+	for (const auto &count : stats.relocationCounts)
+	{
+		appendFormat(output, "    %-24s %10zu\n", getRelocationTypeName(count.first), count.second);
+	}
+	appendFormat(output, "  Relocations by module:\n");
+	for (const auto &count : stats.moduleRelocationCounts)
+	{
+		appendFormat(output, "    %-24u %10zu\n", count.first, count.second);
+	}
+	if (stats.prelinkBase)
+	{
+		appendFormat(output, "  Prelinked for 0x%08X, bss at 0x%08X: %zu relocations applied\n",
+					 stats.prelinkBase, stats.prelinkBssBase, stats.prelinkedCount);
+	}
+	if (stats.deadSectionCount)
+	{
+		appendFormat(output, "  Dead sections removed: %zu, %zu bytes (+%zu bytes bss)\n",
+					 stats.deadSectionCount, stats.deadSectionSize, stats.deadBssSize);
+	}
+	if (stats.hotSectionCount || stats.coldSectionCount)
+	{
+		appendFormat(output, "  Profile: %zu hot sections, %zu bytes, first in .text, %zu cold sections last\n",
+					 stats.hotSectionCount, stats.hotSectionSize, stats.coldSectionCount);
+		if (stats.unknownProfileSymbolCount)
+		{
+			appendFormat(output, "    %zu profiled symbols not in the ELF\n", stats.unknownProfileSymbolCount);
+		}
+	}
+	if (stats.mergedEntryCount)
+	{
+		appendFormat(output, "  Merged constants: %zu duplicates, %zu bytes saved\n", stats.mergedEntryCount, stats.mergedSaving);
+	}
+	if (stats.foldedSectionCount)
+	{
+		appendFormat(output, "  Identical code folded: %zu sections, %zu bytes\n", stats.foldedSectionCount, stats.foldedSize);
+	}
+	if (stats.branchStubCount)
+	{
+		// Every call but one per stub no longer needs a relocation, each stub
+		// adds a branch
+		appendFormat(output, "  Branch stubs: %zu for %zu calls, %zu relocation bytes saved, %zu bytes of code added\n",
+					 stats.branchStubCount, stats.branchStubCallCount,
+					 (stats.branchStubCallCount - stats.branchStubCount) * 8, stats.branchStubCount * 4);
+	}
+	if (stats.exportedSymbolCount)
+	{
+		appendFormat(output, "  Exported symbols: %zu\n", stats.exportedSymbolCount);
+	}
+	appendFormat(output, "  R_DOLPHIN_NOP records: %zu\n", stats.nopCount);
+	appendFormat(output, "  Alignment padding: %zu bytes\n", stats.paddingSize);
+	if (stats.packedSaving || stats.packedBssSaving)
 	{
-		save<uint32_t>(buffer, fixedDataSize);
+		appendFormat(output, "  Saved by packing: %zu bytes (+%zu bytes bss)\n", stats.packedSaving, stats.packedBssSaving);
 	}
+	appendFormat(output, "  Section data: %zu bytes (+%zu bytes bss)\n", stats.sectionDataSize, stats.bssSize);
+	appendFormat(output, "  Import table: %zu bytes\n", stats.importTableSize);
+	appendFormat(output, "  Relocation table: %zu bytes\n", stats.relocationTableSize);
+	appendFormat(output, "  Total: %zu bytes\n", stats.totalSize);
 }
 
-void writeSectionInfo(std::vector<uint8_t> &buffer, int offset, int size)
+void appendJsonString(std::string &output, const std::string &string)
 {
-	save<uint32_t>(buffer, offset);
-	save<uint32_t>(buffer, size);
+	output += '"';
+	for (char c : string)
+	{
+		if (c == '"' || c == '\\')
+		{
+			output += '\\';
+			output += c;
+		}
+		else if (static_cast<unsigned char>(c) < 0x20)
+		{
+			appendFormat(output, "\\u%04x", c);
+		}
+		else
+		{
+			output += c;
+		}
+	}
+	output += '"';
 }
 
-void writeImportInfo(std::vector<uint8_t> &buffer, int id, int offset)
+// Chrome trace event format, every phase is a complete ("X") event on the
+// thread that ran it. Open in chrome://tracing or Perfetto.
+bool writeTrace(const PhaseTimer &timer, const std::string &filename)
 {
-	save<uint32_t>(buffer, id);
-	save<uint32_t>(buffer, offset);
+	std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	const char *separator = "";
+	for (const auto &phase : timer.getPhases())
+	{
+		json += separator;
+		json += "{\"name\":";
+		appendJsonString(json, phase.name);
+		appendFormat(json, ",\"cat\":\"elf2rel\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":1,\"tid\":%d,\"args\":{\"file\":",
+					 static_cast<long long>(phase.startMicroseconds),
+					 static_cast<long long>(phase.durationMicroseconds),
+					 phase.thread);
+		appendJsonString(json, phase.detail);
+		json += "}}";
+		separator = ",\n";
+	}
+	json += "\n]}\n";
+
+	std::ofstream outputStream(filename);
+	outputStream << json;
+	return outputStream.good();
 }
 
-void writeRelocation(std::vector<uint8_t> &buffer, int offset, int type, int section, uint32_t addend)
+// Phase totals in milliseconds, in the order the phases first ran, plus the
+// wall time so far. Phases of parallel jobs add up, so with several jobs the
+// totals can exceed the wall time. Read by bench/bench.py.
+bool writeTimings(const PhaseTimer &timer, const std::string &filename)
 {
-	save<uint16_t>(buffer, offset);
-	save<uint8_t>(buffer, type);
-	save<uint8_t>(buffer, section);
-	save<uint32_t>(buffer, addend);
-}
+	std::string json = "{\n\t\"phases\": {";
+	const char *separator = "\n";
+	for (const auto &total : timer.getTotals())
+	{
+		appendFormat(json, "%s\t\t\"%s\": %.3f", separator, total.first.c_str(), total.second / 1000.0);
+		separator = ",\n";
+	}
+	appendFormat(json, "\n\t},\n\t\"wall\": %.3f\n}\n", timer.getElapsedMicroseconds() / 1000.0);
 
-const std::vector<std::string> cRelSectionMask = {
-	".init",
-	".text",
-	".ctors",
-	".dtors",
-	".rodata",
-	".data",
-	".bss"
-};
+	std::ofstream outputStream(filename);
+	outputStream << json;
+	return outputStream.good();
+}
 
 int main(int argc, char **argv)
 {
-	std::string elfFilename;
-	std::string lstFilename;
-	std::string relFilename = "";
-	int moduleID = 33;
-	int relVersion = 3;
+	ConversionJob singleJob;
+	std::string batchFilename;
+	std::string symbolDbFilename;
+	std::string timingsFilename;
+	std::string traceFilename;
+	std::string prelinkBaseString;
+	std::string prelinkBssString;
+	std::vector<std::string> moduleLstStrings;
+	bool showStats = false;
+	int jobCount = 1;
 
 	{
 		namespace po = boost::program_options;
@@ -135,11 +2741,31 @@ int main(int argc, char **argv)
 		po::options_description description("Options");
 		description.add_options()
 			("help", "Print help message")
-			("input-file,i", po::value(&elfFilename), "Input ELF filename (required)")
-			("symbol-file,s", po::value(&lstFilename), "Input symbol file name (required)")
-			("output-file,o", po::value(&relFilename), "Output REL filename")
-			("rel-id", po::value(&moduleID)->default_value(0x1000), "REL file ID")
-			("rel-version", po::value(&relVersion)->default_value(3), "REL file format version (1, 2, 3)");
+			("input-file,i", po::value(&singleJob.elfFilename), "Input ELF filename (required)")
+			("symbol-file,s", po::value(&singleJob.lstFilename), "Input symbol file name (required)")
+			("module-symbols", po::value(&moduleLstStrings)->composing(), "Symbols of a game REL to import from as <module id>=<lst>, with '<section>,<offset>:<name>' lines, can be given more than once")
+			("output-file,o", po::value(&singleJob.relFilename), "Output REL filename")
+			("rel-id", po::value(&singleJob.moduleID)->default_value(0x1000), "REL file ID")
+			("rel-version", po::value(&singleJob.relVersion)->default_value(3), "REL file format version (1, 2, 3)")
+			("keep-dol-relocations", po::bool_switch(&singleJob.keepDolRelocations), "Leave absolute relocations against the DOL to OSLink instead of applying them")
+			("prelink-base", po::value(&prelinkBaseString), "Resolve all relocations for a REL loaded at this address, OSLink only relocates if it ends up elsewhere")
+			("prelink-bss", po::value(&prelinkBssString), "Bss address to prelink for, defaults to right after the REL like the REL loader does")
+			("gc-sections", po::bool_switch(&singleJob.gcSections), "Drop sections that can't be reached from _prolog, _epilog, _unresolved, .ctors and .dtors")
+			("keep-symbol", po::value(&singleJob.rootSymbols)->composing(), "Symbol whose section --gc-sections must keep, can be given more than once")
+			("pack-sections", po::bool_switch(&singleJob.packSections), "Order sections by alignment and fill alignment gaps to save space")
+			("merge-constants", po::bool_switch(&singleJob.mergeConstants), "Keep identical constants and strings from SHF_MERGE sections only once")
+			("icf", po::bool_switch(&singleJob.foldIdenticalCode), "Fold .text sections with identical code and relocations into one, unless their address is taken")
+			("icf-address-taken", po::bool_switch(&singleJob.foldAddressTaken), "Let --icf also fold sections whose address is taken")
+			("export-map", po::bool_switch(&singleJob.writeExportMap), "Also write where every global symbol ended up to <output>.lst (mod.rel.lst for mod.rel), for other modules to import from with --module-symbols")
+			("branch-stubs", po::value(&singleJob.branchStubMinCalls)->default_value(0), "Call DOL functions called from at least this many places through one branch in .text, which needs one relocation instead of one per call (0 = off)")
+			("profile", po::value(&singleJob.profileFilename), "Function hit counts, one '<symbol> <count>' per line, to put hot .text sections first and code run at most once last")
+			("incremental", po::bool_switch(&singleJob.incremental), "Skip conversions whose inputs didn't change since the last run, tracked in <output>.hash")
+			("symbol-db", po::value(&symbolDbFilename), "Precompiled symbol database to look symbol files up in, (re)built as needed")
+			("batch,b", po::value(&batchFilename), "Manifest of conversions to run instead, one '<elf> <lst> <rel> [rel-id] [rel-version] [<module id>=<lst> ...]' per line")
+			("stats", po::bool_switch(&showStats), "Print timings, relocation counts and sizes for every conversion")
+			("trace", po::value(&traceFilename), "Write a Chrome trace of all phases to a JSON file")
+			("timings", po::value(&timingsFilename), "Write the time spent in each phase to a JSON file")
+			("jobs,j", po::value(&jobCount)->default_value(1), "Number of worker threads (0 = all cores)");
 
 		po::positional_options_description positionals;
 		positionals.add("input-file", -1);
@@ -154,407 +2780,415 @@ int main(int argc, char **argv)
 		);
 		po::notify(varMap);
 
+		bool isBatch = varMap.count("batch") == 1;
 		if (varMap.count("help")
-			|| varMap.count("input-file") != 1
-			|| varMap.count("symbol-file") != 1
-			|| relVersion < 1
-			|| relVersion > 3)
+			|| (!isBatch && varMap.count("input-file") != 1)
+			|| (!isBatch && varMap.count("symbol-file") != 1)
+			|| singleJob.relVersion < 1
+			|| singleJob.relVersion > 3)
 		{
 			std::cout << description << "\n";
 			return 1;
 		}
-	}
 
-	if (relFilename == "")
-	{
-		relFilename = elfFilename.substr(0, elfFilename.find_last_of('.')) + ".rel";
+		// Addresses are usually given in hex
+		singleJob.prelinkBase = strtoul(prelinkBaseString.c_str(), nullptr, 0);
+		singleJob.prelinkBssBase = strtoul(prelinkBssString.c_str(), nullptr, 0);
+		if ((singleJob.prelinkBase & 0x1F) != 0 || (prelinkBssString != "" && singleJob.prelinkBase == 0))
+		{
+			printf("Prelink base must be a non-zero multiple of 0x20\n");
+			return 1;
+		}
+
+		for (const auto &moduleLstString : moduleLstStrings)
+		{
+			std::pair<uint32_t, std::string> moduleLst;
+			if (!parseModuleLst(moduleLstString, moduleLst))
+			{
+				printf("Expected <module id>=<lst> for --module-symbols, got '%s'\n", moduleLstString.c_str());
+				return 1;
+			}
+			singleJob.moduleLstFilenames.emplace_back(moduleLst);
+		}
 	}
-	
-	// Load input file
-	ELFIO::elfio inputElf;
-	if (!inputElf.load(elfFilename))
+
+	if (jobCount <= 0)
 	{
-		printf("Failed to load input file\n");
-		return 1;
+		jobCount = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
 	}
-	
-	auto externalSymbolMap = loadSymbolMap(lstFilename);
 
-	// Find special sections
-	ELFIO::section *symSection = nullptr;
-	std::vector<ELFIO::section *> relocationSections;
-	for (const auto &section : inputElf.sections)
+	std::vector<ConversionJob> jobs;
+	if (batchFilename != "")
 	{
-		if (section->get_type() == SHT_SYMTAB)
+		if (!loadBatchManifest(batchFilename, singleJob, jobs))
 		{
-			symSection = section;
+			return 1;
 		}
-		else if (section->get_type() == SHT_RELA)
+	}
+	else
+	{
+		if (singleJob.relFilename == "")
 		{
-			relocationSections.emplace_back(section);
+			singleJob.relFilename = singleJob.elfFilename.substr(0, singleJob.elfFilename.find_last_of('.')) + ".rel";
 		}
+		jobs.emplace_back(singleJob);
 	}
 
-	// Symbol accessor
-	ELFIO::symbol_section_accessor symbols(inputElf, symSection);
-
-	// Find prolog, epilog and unresolved
-	auto findSymbolSectionAndOffset = [&](const std::string &name, int &sectionIndex, int &offset)
+	// Modules of a batch import from each other through their export maps.
+	// A module is only converted once all modules it imports from are, their
+	// export maps are read only then.
+	std::vector<std::vector<size_t>> jobDependencies(jobs.size());
+	std::set<std::string> exportMapFilenames;
 	{
-		ELFIO::Elf64_Addr addr;
-		ELFIO::Elf_Xword size;
-		unsigned char bind;
-		unsigned char type;
-		ELFIO::Elf_Half section_index;
-		unsigned char other;
-		for (int i = 0; i < symbols.get_symbols_num(); ++i)
+		std::map<std::string, size_t> exportingJobs;
+		for (size_t i = 0; i < jobs.size(); ++i)
 		{
-			std::string symbolName;
-			if (symbols.get_symbol(static_cast<ELFIO::Elf_Xword>(i), symbolName, addr, size, bind, type, section_index, other))
+			if (jobs[i].writeExportMap
+				&& !exportingJobs.emplace(SymbolDatabase::normalizePath(getExportMapFilename(jobs[i])), i).second)
 			{
-				if (symbolName == name)
-				{
-					sectionIndex = static_cast<int>(section_index);
-					offset = static_cast<int>(addr);
-					break;
-				}
+				printf("More than one REL would write the export map '%s'\n", getExportMapFilename(jobs[i]).c_str());
+				return 1;
 			}
 		}
-	};
-
-	int prologSectionIndex = 0, prologOffset = 0;
-	findSymbolSectionAndOffset("_prolog", prologSectionIndex, prologOffset);
-	int epilogSectionIndex = 0, epilogOffset = 0;
-	findSymbolSectionAndOffset("_epilog", epilogSectionIndex, epilogOffset);
-	int unresolvedSectionIndex = 0, unresolvedOffset = 0;
-	findSymbolSectionAndOffset("_unresolved", unresolvedSectionIndex, unresolvedOffset);
-
-	std::vector<uint8_t> outputBuffer;
-	// Dummy values for header until offsets are determined
-	writeModuleHeader(outputBuffer, relVersion, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
-	int sectionInfoOffset = outputBuffer.size();
-	for (int i = 0; i < inputElf.sections.size(); ++i)
-	{
-		writeSectionInfo(outputBuffer, 0, 0);
-	}
 
-	// Write sections
-	std::vector<uint8_t> sectionInfoBuffer;
-	std::map<ELFIO::section *, int> writtenSections;
-	int totalBssSize = 0;
-	int maxAlign = 2;
-	int maxBssAlign = 2;
-	for (const auto &section : inputElf.sections)
-	{
-		// Should keep?
-		if (std::find_if(cRelSectionMask.begin(),
-						  cRelSectionMask.end(),
-						  [&](const std::string &val)
-		{
-			return val == section->get_name()
-				   || section->get_name().find(val + ".") == 0;
-		}) != cRelSectionMask.end())
+		// Writing an export map must never overwrite a symbol map being read
+		for (size_t i = 0; i < jobs.size(); ++i)
 		{
-			// BSS?
-			if (section->get_type() == SHT_NOBITS)
+			std::vector<std::string> inputLstFilenames = { jobs[i].lstFilename };
+			for (const auto &moduleLst : jobs[i].moduleLstFilenames)
 			{
-				// Update max alignment
-				int align = static_cast<int>(section->get_addr_align());
-				maxBssAlign = std::max(maxBssAlign, align);
-
-				int size = static_cast<int>(section->get_size());
-				totalBssSize += size;
-				writeSectionInfo(sectionInfoBuffer, 0, size);
+				// Other RELs' export maps are read only after they are written
+				auto exportingJob = exportingJobs.find(SymbolDatabase::normalizePath(moduleLst.second));
+				if (exportingJob == exportingJobs.end() || exportingJob->second == i)
+				{
+					inputLstFilenames.emplace_back(moduleLst.second);
+				}
 			}
-			else
+			for (const auto &lstFilename : inputLstFilenames)
 			{
-				// Update max alignment (minimum 2, low offset bit is used for exec flag)
-				int align = std::max(static_cast<int>(section->get_addr_align()), 2);
-				maxAlign = std::max(maxAlign, align);
-
-				// Write padding
-				int requiredPadding = ((outputBuffer.size() + align - 1) & ~(align - 1)) - outputBuffer.size();
-				for (int i = 0; i < requiredPadding; ++i)
+				auto exportingJob = exportingJobs.find(SymbolDatabase::normalizePath(lstFilename));
+				if (exportingJob != exportingJobs.end())
 				{
-					save<uint8_t>(outputBuffer, 0);
+					printf("The export map of '%s' would overwrite the symbol map '%s'\n",
+						   jobs[exportingJob->second].relFilename.c_str(), lstFilename.c_str());
+					return 1;
 				}
-
-				int offset = outputBuffer.size();
-
-				int encodedOffset = offset;
-				// Mark executable sections
-				if (section->get_flags() & SHF_EXECINSTR)
+			}
+		}
+		for (size_t i = 0; i < jobs.size(); ++i)
+		{
+			for (const auto &moduleLst : jobs[i].moduleLstFilenames)
+			{
+				auto exportingJob = exportingJobs.find(SymbolDatabase::normalizePath(moduleLst.second));
+				if (exportingJob == exportingJobs.end())
 				{
-					encodedOffset |= 1;
+					continue;
 				}
-				writeSectionInfo(sectionInfoBuffer, encodedOffset, static_cast<int>(section->get_size()));
-				std::vector<uint8_t> sectionData(section->get_data(), section->get_data() + section->get_size());
-				outputBuffer.insert(outputBuffer.end(), sectionData.begin(), sectionData.end());
-
-				writtenSections[section] = offset;
+				if (static_cast<uint32_t>(jobs[exportingJob->second].moduleID) != moduleLst.first)
+				{
+					printf("'%s' is the export map of module %d, not %u\n",
+						   moduleLst.second.c_str(), jobs[exportingJob->second].moduleID, moduleLst.first);
+					return 1;
+				}
+				jobDependencies[i].emplace_back(exportingJob->second);
+				exportMapFilenames.insert(moduleLst.second);
 			}
 		}
-		else
+	}
+
+	// Every distinct input is only loaded once, no matter how many jobs use it
+	std::map<std::string, std::unique_ptr<SymbolMap>> symbolMaps;
+	std::map<std::string, std::unique_ptr<InputElf>> inputElfs;
+	for (const auto &job : jobs)
+	{
+		symbolMaps[job.lstFilename];
+		inputElfs[job.elfFilename];
+	}
+
+	PhaseTimer timer;
+
+	// The database replaces parsing the symbol files altogether
+	SymbolDatabase symbolDatabase;
+	if (symbolDbFilename != "")
+	{
+		auto loadPhase = timer.measure("symbol_map_load", symbolDbFilename);
+		std::vector<std::string> lstFilenames;
+		for (const auto &entry : symbolMaps)
+		{
+			lstFilenames.emplace_back(entry.first);
+		}
+		if (!loadSymbolDatabase(symbolDatabase, symbolDbFilename, lstFilenames))
 		{
-			// Section was removed
-			writeSectionInfo(sectionInfoBuffer, 0, 0);
+			return 1;
 		}
+		symbolMaps.clear();
 	}
-	// Fill in section info in main buffer
-	std::copy(sectionInfoBuffer.begin(), sectionInfoBuffer.end(), outputBuffer.begin() + sectionInfoOffset);
 
-	// Find all relocations
-	struct Relocation
-	{
-		uint32_t moduleID; // target module
-		uint32_t section;
-		uint32_t offset;
-		uint8_t targetSection;  // target symbol
-		uint32_t addend;
-		uint8_t type;
-	};
-	std::deque<Relocation> allRelocations;
-	for (const auto &section : relocationSections)
+	// Game REL symbols aren't part of the database, they are always parsed
+	for (const auto &job : jobs)
 	{
-		int relocatedSectionIndex = section->get_info();
-		ELFIO::section *relocatedSection = inputElf.sections[relocatedSectionIndex];
-		// Only relocate sections that were written
-		if (writtenSections.find(relocatedSection) != writtenSections.end())
+		for (const auto &moduleLst : job.moduleLstFilenames)
 		{
-			ELFIO::relocation_section_accessor relocations(inputElf, section);
-			// #todo-elf2rel: Process relocations
-			for (int i = 0; i < relocations.get_entries_num(); ++i)
+			if (!exportMapFilenames.count(moduleLst.second))
 			{
-				ELFIO::Elf64_Addr offset;
-				ELFIO::Elf_Word symbol;
-				ELFIO::Elf_Word type;
-				ELFIO::Elf_Sxword addend;
-				relocations.get_entry(i, offset, symbol, type, addend);
+				symbolMaps[moduleLst.second];
+			}
+		}
+	}
 
-				// Ignore R_PPC_NONE
-				if (type == R_PPC_NONE)
-					continue;
+	std::vector<std::pair<const std::string, std::unique_ptr<SymbolMap>> *> pendingSymbolMaps;
+	for (auto &entry : symbolMaps)
+	{
+		pendingSymbolMaps.emplace_back(&entry);
+	}
+	std::vector<std::pair<const std::string, std::unique_ptr<InputElf>> *> pendingElfs;
+	for (auto &entry : inputElfs)
+	{
+		pendingElfs.emplace_back(&entry);
+	}
 
-				ELFIO::Elf_Xword size;
-				unsigned char bind;
-				unsigned char symbolType;
-				ELFIO::Elf_Half sectionIndex;
-				unsigned char other;
-				std::string symbolName;
-				ELFIO::Elf64_Addr symbolValue;
-				if (!symbols.get_symbol(symbol, symbolName, symbolValue,
-										size, bind, symbolType, sectionIndex, other))
-				{
-					printf("Unable to find symbol %u in symbol table!\n", static_cast<uint32_t>(symbol));
-					return 1;
-				}
+	ThreadPool threadPool(jobCount);
+	std::vector<std::string> symbolMapLogs(pendingSymbolMaps.size());
+	threadPool.run(pendingSymbolMaps.size() + pendingElfs.size(), [&](size_t taskIndex, int)
+	{
+		if (taskIndex < pendingSymbolMaps.size())
+		{
+			auto &entry = *pendingSymbolMaps[taskIndex];
+			auto loadPhase = timer.measure("symbol_map_load", entry.first);
+			auto symbolMap = std::make_unique<SymbolMap>();
+			if (symbolMap->load(entry.first, symbolMapLogs[taskIndex]))
+			{
+				entry.second = std::move(symbolMap);
+			}
+			return;
+		}
 
-				// Add relocation to list
-				bool resolved = false;
-				Relocation rel;
-				rel.section = relocatedSectionIndex;
-				rel.offset = static_cast<uint32_t>(offset);
-				rel.type = type;
-				if (sectionIndex)
-				{
-					// Self-relocation
-					resolved = true;
+		auto &entry = *pendingElfs[taskIndex - pendingSymbolMaps.size()];
+		auto loadPhase = timer.measure("elf_load", entry.first);
+		auto input = std::make_unique<InputElf>();
+		if (loadInputElf(*input, entry.first))
+		{
+			entry.second = std::move(input);
+		}
+	});
 
-					rel.moduleID = moduleID;
-					rel.targetSection = static_cast<uint8_t>(sectionIndex);
-					rel.addend = static_cast<uint32_t>(addend + symbolValue);
+	for (const auto &log : symbolMapLogs)
+	{
+		fputs(log.c_str(), stdout);
+	}
 
-					ELFIO::section *targetSection = inputElf.sections[rel.targetSection];
-					if (writtenSections.find(targetSection) == writtenSections.end() && targetSection->get_type() != SHT_NOBITS)
-					{
-						printf("Relocation from section '%s' offset %llx against symbol '%s' in unwritten section '%s'\n",
-							   relocatedSection->get_name().c_str(),
-							   offset,
-							   symbolName.c_str(),
-							   targetSection->get_name().c_str());
-					}
-				}
-				else
-				{
-					// Symbol is unknown, check if it's an external known symbol
-					auto it = externalSymbolMap.find(symbolName);
-					if (it != externalSymbolMap.end())
-					{
-						// Known external!
-						resolved = true;
+	// What a module imports from another one has to survive the other
+	// one's --gc-sections
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		const InputElf *input = inputElfs.at(jobs[i].elfFilename).get();
+		for (size_t exportingJob : jobDependencies[i])
+		{
+			const InputElf *exportingInput = inputElfs.at(jobs[exportingJob].elfFilename).get();
+			if (!input || !exportingInput)
+			{
+				continue;
+			}
 
-						rel.moduleID = 0;
-						rel.targetSection = 0; // #todo-elf2rel: Check if this is important
-						rel.addend = static_cast<uint32_t>(addend + it->second);
-					}
+			std::set<std::string> importedSymbols;
+			const SymbolIndex &symbols = *input->symbols;
+			const SymbolIndex &exportingSymbols = *exportingInput->symbols;
+			for (uint32_t symbol = 0; symbol < symbols.size(); ++symbol)
+			{
+				std::string_view name = symbols.getName(symbol);
+				if (symbols.getSectionIndex(symbol) != 0 || name.empty())
+				{
+					continue;
 				}
 
-				if (resolved)
+				uint32_t exportingSymbol = exportingSymbols.find(name);
+				if (exportingSymbol != SymbolIndex::cInvalidIndex && exportingSymbols.getSectionIndex(exportingSymbol) != 0)
 				{
-					allRelocations.emplace_back(rel);
+					importedSymbols.emplace(name);
 				}
-				else
+			}
+			std::vector<std::string> &rootSymbols = jobs[exportingJob].rootSymbols;
+			for (const auto &name : importedSymbols)
+			{
+				if (std::find(rootSymbols.begin(), rootSymbols.end(), name) == rootSymbols.end())
 				{
-					printf("Unresolved external symbol '%s'\n", symbolName.c_str());
+					rootSymbols.emplace_back(name);
 				}
 			}
 		}
 	}
 
-	// Sort relocations
-	std::sort(allRelocations.begin(), allRelocations.end(),
-			  [](const Relocation &left, const Relocation &right)
-	{
-		return std::tuple<uint32_t, uint32_t, uint32_t>(left.moduleID, left.section, left.offset)
-			   < std::tuple<uint32_t, uint32_t, uint32_t>(right.moduleID, right.section, right.offset);
-	});
-
-	// Count modules
-	int importCount = 0;
-	int lastModuleID = -1;
-	for (const auto &rel : allRelocations)
+	// With several jobs each one runs on its own thread, a lone job gets the
+	// whole pool for its relocations instead
+	int innerJobCount = jobs.size() > 1 ? 1 : jobCount;
+	std::vector<std::string> logs(jobs.size());
+	std::vector<int> results(jobs.size(), 1);
+	std::vector<ConversionStats> stats(jobs.size());
+	auto runJob = [&](size_t jobIndex)
 	{
-		if (lastModuleID != rel.moduleID)
+		const ConversionJob &job = jobs[jobIndex];
+		const InputElf *input = inputElfs.at(job.elfFilename).get();
+		if (!input)
 		{
-			lastModuleID = rel.moduleID;
-			++importCount;
+			appendFormat(logs[jobIndex], "Failed to load input file '%s'\n", job.elfFilename.c_str());
+			return;
+		}
+		for (size_t exportingJob : jobDependencies[jobIndex])
+		{
+			if (results[exportingJob] != 0)
+			{
+				appendFormat(logs[jobIndex], "Not converted, module %d it imports from failed\n", jobs[exportingJob].moduleID);
+				return;
+			}
 		}
-	}
-
-	// Write padding for imports
-	int requiredPadding = 8 - outputBuffer.size() % 8;
-	for (int i = 0; i < requiredPadding; ++i)
-	{
-		save<uint8_t>(outputBuffer, 0);
-	}
 
-	// Write dummy imports
-	int importInfoOffset = outputBuffer.size();
-	for (int i = 0; i < importCount; ++i)
-	{
-		writeImportInfo(outputBuffer, 0, 0);
-	}
+		ExternalSymbols externalSymbols;
+		if (symbolDbFilename != "")
+		{
+			externalSymbols.database = &symbolDatabase;
+			externalSymbols.region = symbolDatabase.findRegion(SymbolDatabase::normalizePath(job.lstFilename));
+		}
+		else
+		{
+			externalSymbols.map = symbolMaps.at(job.lstFilename).get();
+			if (!externalSymbols.map)
+			{
+				appendFormat(logs[jobIndex], "Failed to load symbol file '%s'\n", job.lstFilename.c_str());
+				return;
+			}
+		}
+		for (const auto &moduleLst : job.moduleLstFilenames)
+		{
+			const SymbolMap *moduleMap = symbolMaps.at(moduleLst.second).get();
+			if (!moduleMap)
+			{
+				appendFormat(logs[jobIndex], "Failed to load symbol file '%s'\n", moduleLst.second.c_str());
+				return;
+			}
+			if (moduleLst.first == static_cast<uint32_t>(job.moduleID))
+			{
+				appendFormat(logs[jobIndex], "Symbol file '%s' is for module %u, which is the REL itself\n",
+							 moduleLst.second.c_str(), moduleLst.first);
+				return;
+			}
+			externalSymbols.modules.emplace_back(moduleLst.first, moduleMap);
+		}
 
-	// Write out relocations
-	int relocationOffset = outputBuffer.size();
+		results[jobIndex] = convertElf(*input, externalSymbols, job, innerJobCount, timer, stats[jobIndex], logs[jobIndex]);
+	};
 
-	std::vector<uint8_t> importInfoBuffer;
-	int currentModuleID = -1;
-	int currentSectionIndex = -1;
-	int currentOffset = 0;
-	while (!allRelocations.empty())
+	// Convert in waves of modules whose imports are all converted
+	std::vector<bool> isConverted(jobs.size(), false);
+	for (size_t convertedCount = 0; convertedCount < jobs.size(); )
 	{
-		Relocation nextRel = allRelocations.front();
-		allRelocations.pop_front();
-		
-		// Resolve early if possible
-		if (nextRel.moduleID == moduleID && (nextRel.type == R_PPC_REL24 || nextRel.type == R_PPC_REL32))
+		std::vector<size_t> readyJobs;
+		for (size_t i = 0; i < jobs.size(); ++i)
 		{
-			int offset = writtenSections.at(inputElf.sections[nextRel.section]) + nextRel.offset;
-			int delta = writtenSections.at(inputElf.sections[nextRel.targetSection]) + nextRel.addend - offset;
-			std::vector<uint8_t> instructionBuffer(outputBuffer.begin() + offset, outputBuffer.begin() + offset + 4);
-			uint32_t patchedData;
-			load(instructionBuffer, patchedData);
-			
-			if (nextRel.type == R_PPC_REL24)
+			if (!isConverted[i] && std::all_of(jobDependencies[i].begin(), jobDependencies[i].end(), [&](size_t exportingJob)
 			{
-				patchedData |= (delta & 0x03FFFFFC);
+				return isConverted[exportingJob];
+			}))
+			{
+				readyJobs.emplace_back(i);
 			}
-			else if (nextRel.type == R_PPC_REL32)
+		}
+		if (readyJobs.empty())
+		{
+			for (size_t i = 0; i < jobs.size(); ++i)
 			{
-				patchedData = delta;
+				if (!isConverted[i])
+				{
+					appendFormat(logs[i], "Not converted, module %d imports from modules that import from it\n", jobs[i].moduleID);
+				}
 			}
-			
-			save(instructionBuffer, patchedData);
-			std::copy(instructionBuffer.begin(), instructionBuffer.end(), outputBuffer.begin() + offset);
-
-			continue;
+			break;
 		}
 
-		// Change module if necessary
-		if (currentModuleID != nextRel.moduleID)
+		for (size_t jobIndex : readyJobs)
 		{
-			// Not first module?
-			if (currentModuleID != -1)
+			for (const auto &moduleLst : jobs[jobIndex].moduleLstFilenames)
 			{
-				writeRelocation(outputBuffer, 0, R_DOLPHIN_END, 0, 0);
+				std::unique_ptr<SymbolMap> &symbolMap = symbolMaps[moduleLst.second];
+				if (exportMapFilenames.count(moduleLst.second) && !symbolMap)
+				{
+					auto loadPhase = timer.measure("symbol_map_load", moduleLst.second);
+					symbolMap = std::make_unique<SymbolMap>();
+					std::string symbolMapLog;
+					if (!symbolMap->load(moduleLst.second, symbolMapLog))
+					{
+						symbolMap.reset();
+					}
+					fputs(symbolMapLog.c_str(), stdout);
+				}
 			}
+		}
 
-			currentModuleID = nextRel.moduleID;
-			currentSectionIndex = -1;
-			writeImportInfo(importInfoBuffer, currentModuleID, outputBuffer.size());
+		threadPool.run(readyJobs.size(), [&](size_t taskIndex, int)
+		{
+			runJob(readyJobs[taskIndex]);
+		});
+		for (size_t jobIndex : readyJobs)
+		{
+			isConverted[jobIndex] = true;
 		}
+		convertedCount += readyJobs.size();
+	}
 
-		// Change section if necessary
-		if (currentSectionIndex != nextRel.section)
+	// Report in manifest order
+	int failedCount = 0;
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		if (jobs.size() > 1 && !logs[i].empty())
 		{
-			currentSectionIndex = nextRel.section;
-			currentOffset = 0;
-			writeRelocation(outputBuffer, 0, R_DOLPHIN_SECTION, currentSectionIndex, 0);
+			printf("%s:\n", jobs[i].relFilename.c_str());
 		}
+		fputs(logs[i].c_str(), stdout);
 
-		// Get into range of the target
-		int targetDelta = nextRel.offset - currentOffset;
-		while (targetDelta > 0xFFFF)
+		if (results[i] != 0)
 		{
-			writeRelocation(outputBuffer, 0xFFFF, R_DOLPHIN_NOP, 0, 0);
-			targetDelta -= 0xFFFF;
+			++failedCount;
 		}
-		
-		// #todo-elf2rel: Add runtime unresolved symbol handling here
-		// At this point, only symbols that OSLink can handle should remain
-		switch (nextRel.type)
+		else if (showStats)
 		{
-		case R_PPC_NONE:
-		case R_PPC_ADDR32:
-		case R_PPC_ADDR24:
-		case R_PPC_ADDR16:
-		case R_PPC_ADDR16_LO:
-		case R_PPC_ADDR16_HI:
-		case R_PPC_ADDR16_HA:
-		case R_PPC_ADDR14:
-		case R_PPC_ADDR14_BRTAKEN:
-		case R_PPC_ADDR14_BRNKTAKEN:
-		case R_PPC_REL24:
-		case R_DOLPHIN_NOP:
-		case R_DOLPHIN_SECTION:
-		case R_DOLPHIN_END:
-			break;
-		default:
-			printf("Unsupported relocation type %d\n", nextRel.type);
-			break;
+			// Loads shared with other jobs are listed for each of them
+			std::vector<PhaseTimer::Phase> phases;
+			for (const auto &phase : timer.getPhases())
+			{
+				if (phase.detail == jobs[i].relFilename
+					|| phase.detail == jobs[i].elfFilename
+					|| phase.detail == jobs[i].lstFilename
+					|| (symbolDbFilename != "" && phase.detail == symbolDbFilename)
+					|| std::any_of(jobs[i].moduleLstFilenames.begin(), jobs[i].moduleLstFilenames.end(), [&](const std::pair<uint32_t, std::string> &moduleLst)
+					{
+						return phase.detail == moduleLst.second;
+					}))
+				{
+					phases.emplace_back(phase);
+				}
+			}
+
+			std::string output;
+			appendStats(output, jobs[i], stats[i], phases);
+			fputs(output.c_str(), stdout);
 		}
+	}
 
-		writeRelocation(outputBuffer, targetDelta, nextRel.type, nextRel.targetSection, nextRel.addend);
-		currentOffset = nextRel.offset;
+	if (jobs.size() > 1 && failedCount > 0)
+	{
+		printf("%d of %d conversions failed\n", failedCount, static_cast<int>(jobs.size()));
 	}
-	writeRelocation(outputBuffer, 0, R_DOLPHIN_END, 0, 0);
 
-	// Write final import infos
-	int importInfoSize = importInfoBuffer.size();
-	std::copy(importInfoBuffer.begin(), importInfoBuffer.end(), outputBuffer.begin() + importInfoOffset);
-		
-	// Write final header
-	std::vector<uint8_t> headerBuffer;
-	writeModuleHeader(headerBuffer,
-					  relVersion,
-					  moduleID,
-					  inputElf.sections.size(),
-					  sectionInfoOffset,
-					  totalBssSize,
-					  relocationOffset,
-					  importInfoOffset,
-					  importInfoSize,
-					  prologSectionIndex, epilogSectionIndex, unresolvedSectionIndex,
-					  prologOffset, epilogOffset, unresolvedOffset,
-					  maxAlign,
-					  maxBssAlign,
-					  relocationOffset);
-	std::copy(headerBuffer.begin(), headerBuffer.end(), outputBuffer.begin());
+	if (traceFilename != "" && !writeTrace(timer, traceFilename))
+	{
+		printf("Failed to write trace file '%s'\n", traceFilename.c_str());
+		return 1;
+	}
 
-	// Write final REL file
-	std::ofstream outputStream(relFilename, std::ios::binary);
-	outputStream.write(reinterpret_cast<const char *>(outputBuffer.data()), outputBuffer.size());
-	
-	return 0;
-}
\ No newline at end of file
+	if (timingsFilename != "" && !writeTimings(timer, timingsFilename))
+	{
+		printf("Failed to write timings file '%s'\n", timingsFilename.c_str());
+		return 1;
+	}
+
+	return failedCount > 0 ? 1 : 0;
+}
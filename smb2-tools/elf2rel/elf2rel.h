@@ -3,8 +3,15 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
 #include <vector>
 
+// printf into a string, used to collect diagnostics from worker threads
+void appendFormat(std::string &output, const char *format, ...);
+
 enum RelRelocationType
 {
 	R_PPC_NONE = 0,
@@ -19,6 +26,8 @@ enum RelRelocationType
 	R_PPC_ADDR14_BRNKTAKEN,
 	R_PPC_REL24,
 	R_PPC_REL14,
+	R_PPC_REL14_BRTAKEN,
+	R_PPC_REL14_BRNKTAKEN,
 
 	R_PPC_REL32 = 26,
 
@@ -27,22 +36,79 @@ enum RelRelocationType
 	R_DOLPHIN_END,
 };
 
-template<typename T>
-void save(std::vector<uint8_t> &buffer, const T &value)
+// Big-endian output buffer for REL images. Data is appended with put and
+// earlier fields (header, tables, early-resolved relocations) are filled in
+// place with patchAt/readAt instead of going through temporary buffers.
+class RelWriter
 {
-	for (size_t i = sizeof(T); i > 0; --i)
+public:
+	void reserve(size_t size)
 	{
-		buffer.emplace_back(static_cast<uint8_t>((value >> (i - 1) * 8) & 0xFF));
+		mBuffer.reserve(size);
 	}
-}
 
-template<typename T>
-void load(std::vector<uint8_t> &buffer, T &value)
-{
-	value = 0;
-	for (size_t i = sizeof(T); i > 0; --i)
+	size_t size() const
+	{
+		return mBuffer.size();
+	}
+
+	const uint8_t *data() const
+	{
+		return mBuffer.data();
+	}
+
+	template<typename T>
+	void put(T value)
+	{
+		size_t offset = mBuffer.size();
+		mBuffer.resize(offset + sizeof(T));
+		patchAt<T>(offset, value);
+	}
+
+	void putBytes(const void *data, size_t size)
+	{
+		const uint8_t *bytes = static_cast<const uint8_t *>(data);
+		mBuffer.insert(mBuffer.end(), bytes, bytes + size);
+	}
+
+	void putPadding(size_t count)
 	{
-		value |= static_cast<T>(buffer.front()) << ((i - 1) * 8);
-		buffer.erase(buffer.begin());
+		mBuffer.resize(mBuffer.size() + count, 0);
 	}
-}
\ No newline at end of file
+
+	// Pads with zeroes to the given power of two alignment
+	void alignTo(size_t alignment)
+	{
+		putPadding(((mBuffer.size() + alignment - 1) & ~(alignment - 1)) - mBuffer.size());
+	}
+
+	template<typename T>
+	void patchAt(size_t offset, T value)
+	{
+		for (size_t i = 0; i < sizeof(T); ++i)
+		{
+			mBuffer[offset + i] = static_cast<uint8_t>((value >> ((sizeof(T) - 1 - i) * 8)) & 0xFF);
+		}
+	}
+
+	template<typename T>
+	T readAt(size_t offset) const
+	{
+		T value = 0;
+		for (size_t i = 0; i < sizeof(T); ++i)
+		{
+			value = static_cast<T>((value << 8) | mBuffer[offset + i]);
+		}
+		return value;
+	}
+
+	bool writeToFile(const std::string &filename) const
+	{
+		std::ofstream outputStream(filename, std::ios::binary);
+		outputStream.write(reinterpret_cast<const char *>(mBuffer.data()), mBuffer.size());
+		return outputStream.good();
+	}
+
+private:
+	std::vector<uint8_t> mBuffer;
+};
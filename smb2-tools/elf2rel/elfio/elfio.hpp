@@ -41,6 +41,7 @@ THE SOFTWARE.
 
 #include <elfio/elf_types.hpp>
 #include <elfio/elfio_utils.hpp>
+#include <elfio/elfio_image.hpp>
 #include <elfio/elfio_header.hpp>
 #include <elfio/elfio_section.hpp>
 #include <elfio/elfio_segment.hpp>
@@ -117,32 +118,46 @@ class elfio
         stream.seekg( 0 );
         stream.read( reinterpret_cast<char*>( &e_ident ), sizeof( e_ident ) );
 
-        // Is it ELF file?
         if ( stream.gcount() != sizeof( e_ident ) ||
-             e_ident[EI_MAG0] != ELFMAG0    ||
-             e_ident[EI_MAG1] != ELFMAG1    ||
-             e_ident[EI_MAG2] != ELFMAG2    ||
-             e_ident[EI_MAG3] != ELFMAG3 ) {
+             !create_header_from_ident( e_ident ) ) {
             return false;
         }
-
-        if ( ( e_ident[EI_CLASS] != ELFCLASS64 ) &&
-             ( e_ident[EI_CLASS] != ELFCLASS32 )) {
+        if ( !header->load( stream ) ) {
             return false;
         }
 
-        convertor.setup( e_ident[EI_DATA] );
+        load_sections( stream );
+        load_segments( stream );
 
-        header = create_header( e_ident[EI_CLASS], e_ident[EI_DATA] );
-        if ( 0 == header ) {
+        return true;
+    }
+
+//------------------------------------------------------------------------------
+    // Maps the file (or falls back to reading it on demand into a single
+    // buffer if mapping is not possible) and loads the headers from that
+    // image. Section and segment data is only fetched on the first get_data()
+    // and points directly into the image, which stays alive until the next
+    // load or the destruction of this object.
+    bool load_mapped( const std::string& file_name )
+    {
+        clean();
+
+        if ( !image.open( file_name ) ) {
             return false;
         }
-        if ( !header->load( stream ) ) {
+
+        const char* e_ident = image.get_range( 0, EI_NIDENT );
+        if ( 0 == e_ident ||
+             !create_header_from_ident(
+                 reinterpret_cast<const unsigned char*>( e_ident ) ) ) {
+            return false;
+        }
+        if ( !header->load( image ) ) {
             return false;
         }
 
-        load_sections( stream );
-        load_segments( stream );
+        load_sections( image );
+        load_segments( image );
 
         return true;
     }
@@ -266,6 +281,30 @@ class elfio
             delete *it1;
         }
         segments_.clear();
+
+        image.close();
+    }
+
+//------------------------------------------------------------------------------
+    bool create_header_from_ident( const unsigned char* e_ident )
+    {
+        // Is it ELF file?
+        if ( e_ident[EI_MAG0] != ELFMAG0    ||
+             e_ident[EI_MAG1] != ELFMAG1    ||
+             e_ident[EI_MAG2] != ELFMAG2    ||
+             e_ident[EI_MAG3] != ELFMAG3 ) {
+            return false;
+        }
+
+        if ( ( e_ident[EI_CLASS] != ELFCLASS64 ) &&
+             ( e_ident[EI_CLASS] != ELFCLASS32 )) {
+            return false;
+        }
+
+        convertor.setup( e_ident[EI_DATA] );
+
+        header = create_header( e_ident[EI_CLASS], e_ident[EI_DATA] );
+        return 0 != header;
     }
 
 //------------------------------------------------------------------------------
@@ -350,7 +389,8 @@ class elfio
     }
 
 //------------------------------------------------------------------------------
-    Elf_Half load_sections( std::istream& stream )
+    template< class Source >
+    Elf_Half load_sections( Source& source )
     {
         Elf_Half  entry_size = header->get_section_entry_size();
         Elf_Half  num        = header->get_sections_num();
@@ -358,7 +398,7 @@ class elfio
 
         for ( Elf_Half i = 0; i < num; ++i ) {
             section* sec = create_section();
-            sec->load( stream, (std::streamoff)offset + i * entry_size );
+            sec->load( source, (std::streamoff)offset + i * entry_size );
             sec->set_index( i );
             // To mark that the section is not permitted to reassign address
             // during layout calculation
@@ -382,7 +422,8 @@ class elfio
     }
 
 //------------------------------------------------------------------------------
-    bool load_segments( std::istream& stream )
+    template< class Source >
+    bool load_segments( Source& source )
     {
         Elf_Half  entry_size = header->get_segment_entry_size();
         Elf_Half  num        = header->get_segments_num();
@@ -402,7 +443,7 @@ class elfio
                 return false;
             }
 
-            seg->load( stream, (std::streamoff)offset + i * entry_size );
+            seg->load( source, (std::streamoff)offset + i * entry_size );
             seg->set_index( i );
 
             // Add sections to the segments (similar to readelfs algorithm)
@@ -774,6 +815,16 @@ class elfio
             return parent->sections_.end();
         }
 
+//------------------------------------------------------------------------------
+        std::vector<section*>::const_iterator begin() const {
+            return parent->sections_.begin();
+        }
+
+//------------------------------------------------------------------------------
+        std::vector<section*>::const_iterator end() const {
+            return parent->sections_.end();
+        }
+
 //------------------------------------------------------------------------------
       private:
         elfio* parent;
@@ -830,6 +881,7 @@ class elfio
     std::vector<section*> sections_;
     std::vector<segment*> segments_;
     endianess_convertor   convertor;
+    elf_image             image;
 
     Elf_Xword current_file_pos;
 };
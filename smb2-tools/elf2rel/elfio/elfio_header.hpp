@@ -32,6 +32,7 @@ class elf_header
   public:
     virtual ~elf_header() {};
     virtual bool load( std::istream& stream )       = 0;
+    virtual bool load( const elf_image& image )     = 0;
     virtual bool save( std::ostream& stream ) const = 0;
 
     // ELF header functions
@@ -106,6 +107,19 @@ template< class T > class elf_header_impl : public elf_header
         return (stream.gcount() == sizeof( header ) );
     }
 
+    bool
+    load( const elf_image& image )
+    {
+        const char* p = image.get_range( 0, sizeof( header ) );
+        if ( 0 == p ) {
+            return false;
+        }
+
+        std::copy( p, p + sizeof( header ), reinterpret_cast<char*>( &header ) );
+
+        return true;
+    }
+
     bool
     save( std::ostream& stream ) const
     {
@@ -0,0 +1,347 @@
+/*
+Copyright (C) 2001-2015 by Serge Lamikhov-Center
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef ELFIO_IMAGE_HPP
+#define ELFIO_IMAGE_HPP
+
+#include <string>
+#include <fstream>
+#include <new>
+#include <mutex>
+#include <map>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ELFIO {
+
+//------------------------------------------------------------------------------
+// Read-only image of a whole ELF file. The file is memory mapped when the
+// platform allows it, otherwise a single arena the size of the file is
+// allocated and each byte range is read into it the first time it is
+// requested. Bytes already read are never read again, so pointers handed out
+// earlier stay valid while other ranges are loaded. Either way, parts of the
+// file nobody asks for are never read. Sections loaded from an image keep
+// pointers into it instead of copies.
+// get_range() may be called from several threads at once.
+class elf_image
+{
+  public:
+//------------------------------------------------------------------------------
+    elf_image()
+    {
+        data      = 0;
+        size      = 0;
+        arena     = 0;
+        is_mapped = false;
+#ifdef _WIN32
+        mapping   = 0;
+#endif
+    }
+
+//------------------------------------------------------------------------------
+    ~elf_image()
+    {
+        close();
+    }
+
+//------------------------------------------------------------------------------
+    bool
+    open( const std::string& file_name )
+    {
+        close();
+
+        if ( map( file_name ) ) {
+            is_mapped = true;
+            return true;
+        }
+
+        return read( file_name );
+    }
+
+//------------------------------------------------------------------------------
+    void
+    close()
+    {
+        if ( is_mapped ) {
+#ifdef _WIN32
+            UnmapViewOfFile( data );
+            CloseHandle( mapping );
+            mapping = 0;
+#else
+            munmap( const_cast<char*>( data ), size );
+#endif
+        }
+        delete [] arena;
+        if ( stream.is_open() ) {
+            stream.close();
+        }
+        loaded_ranges.clear();
+
+        data      = 0;
+        size      = 0;
+        arena     = 0;
+        is_mapped = false;
+    }
+
+//------------------------------------------------------------------------------
+    const char*
+    get_data() const
+    {
+        return data;
+    }
+
+//------------------------------------------------------------------------------
+    Elf_Xword
+    get_size() const
+    {
+        return size;
+    }
+
+//------------------------------------------------------------------------------
+    bool
+    is_memory_mapped() const
+    {
+        return is_mapped;
+    }
+
+//------------------------------------------------------------------------------
+    // Returns a pointer to the given byte range, or 0 if it is out of bounds
+    // or could not be read
+    const char*
+    get_range( Elf64_Off offset, Elf_Xword range_size ) const
+    {
+        if ( offset > size || range_size > size - offset ) {
+            return 0;
+        }
+
+        if ( 0 != arena && 0 != range_size ) {
+            // Not mapped, pull the missing parts of the range into the arena
+            // now. The stream is shared by every section of the image.
+            std::lock_guard<std::mutex> lock( stream_mutex );
+            if ( !load_range( offset, offset + range_size ) ) {
+                return 0;
+            }
+        }
+
+        return data + offset;
+    }
+
+//------------------------------------------------------------------------------
+  private:
+//------------------------------------------------------------------------------
+    elf_image( const elf_image& );
+    elf_image& operator=( const elf_image& );
+
+//------------------------------------------------------------------------------
+    bool
+    map( const std::string& file_name )
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileA( file_name.c_str(), GENERIC_READ,
+                                   FILE_SHARE_READ, 0, OPEN_EXISTING,
+                                   FILE_ATTRIBUTE_NORMAL, 0 );
+        if ( INVALID_HANDLE_VALUE == file ) {
+            return false;
+        }
+
+        LARGE_INTEGER file_size;
+        if ( !GetFileSizeEx( file, &file_size ) || 0 == file_size.QuadPart ) {
+            CloseHandle( file );
+            return false;
+        }
+
+        mapping = CreateFileMappingA( file, 0, PAGE_READONLY, 0, 0, 0 );
+        CloseHandle( file );
+        if ( 0 == mapping ) {
+            return false;
+        }
+
+        void* view = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+        if ( 0 == view ) {
+            CloseHandle( mapping );
+            mapping = 0;
+            return false;
+        }
+
+        data = static_cast<const char*>( view );
+        size = (Elf_Xword)file_size.QuadPart;
+        return true;
+#else
+        int fd = ::open( file_name.c_str(), O_RDONLY );
+        if ( fd < 0 ) {
+            return false;
+        }
+
+        struct stat file_stat;
+        if ( fstat( fd, &file_stat ) != 0 || file_stat.st_size <= 0 ) {
+            ::close( fd );
+            return false;
+        }
+
+        void* view = mmap( 0, (size_t)file_stat.st_size, PROT_READ,
+                           MAP_PRIVATE, fd, 0 );
+        ::close( fd );
+        if ( MAP_FAILED == view ) {
+            return false;
+        }
+
+        data = static_cast<const char*>( view );
+        size = (Elf_Xword)file_stat.st_size;
+        return true;
+#endif
+    }
+
+//------------------------------------------------------------------------------
+    bool
+    read( const std::string& file_name )
+    {
+        stream.open( file_name.c_str(),
+                     std::ios::in | std::ios::binary | std::ios::ate );
+        if ( !stream ) {
+            return false;
+        }
+
+        std::streamoff file_size = stream.tellg();
+        if ( file_size <= 0 ) {
+            stream.close();
+            return false;
+        }
+
+        // Left uninitialized, ranges are filled in by get_range
+        try {
+            arena = new char[(size_t)file_size];
+        } catch ( const std::bad_alloc& ) {
+            arena = 0;
+            stream.close();
+            return false;
+        }
+
+        data = arena;
+        size = (Elf_Xword)file_size;
+        return true;
+    }
+
+//------------------------------------------------------------------------------
+    // Reads the parts of [start, end) that aren't in the arena yet, the
+    // caller holds stream_mutex
+    bool
+    load_range( Elf64_Off start, Elf64_Off end ) const
+    {
+        // Start at the last loaded range beginning at or before start
+        std::map<Elf64_Off, Elf64_Off>::iterator range =
+            loaded_ranges.upper_bound( start );
+        if ( range != loaded_ranges.begin() ) {
+            --range;
+        }
+
+        Elf64_Off position = start;
+        while ( position < end ) {
+            if ( range != loaded_ranges.end() && range->first <= position ) {
+                // Already loaded up to the end of this range
+                if ( range->second > position ) {
+                    position = range->second;
+                }
+                ++range;
+                continue;
+            }
+
+            // Read up to the next loaded range
+            Elf64_Off gap_end = end;
+            if ( range != loaded_ranges.end() && range->first < gap_end ) {
+                gap_end = range->first;
+            }
+            stream.clear();
+            stream.seekg( (std::streamoff)position );
+            stream.read( arena + position, (std::streamsize)( gap_end - position ) );
+            if ( stream.gcount() != (std::streamsize)( gap_end - position ) ) {
+                return false;
+            }
+            add_range( position, gap_end );
+            range    = loaded_ranges.upper_bound( gap_end );
+            if ( range != loaded_ranges.begin() ) {
+                --range;
+            }
+            position = gap_end;
+        }
+
+        return true;
+    }
+
+//------------------------------------------------------------------------------
+    // Records [start, end) as loaded, merging it with touching ranges
+    void
+    add_range( Elf64_Off start, Elf64_Off end ) const
+    {
+        std::map<Elf64_Off, Elf64_Off>::iterator range =
+            loaded_ranges.upper_bound( start );
+        if ( range != loaded_ranges.begin() ) {
+            std::map<Elf64_Off, Elf64_Off>::iterator previous = range;
+            --previous;
+            if ( previous->second >= start ) {
+                start = previous->first;
+                if ( previous->second > end ) {
+                    end = previous->second;
+                }
+                range = previous;
+            }
+        }
+        while ( range != loaded_ranges.end() && range->first <= end ) {
+            if ( range->second > end ) {
+                end = range->second;
+            }
+            range = loaded_ranges.erase( range );
+        }
+        loaded_ranges[start] = end;
+    }
+
+//------------------------------------------------------------------------------
+  private:
+    const char* data;
+    Elf_Xword   size;
+    char*       arena;
+    bool        is_mapped;
+
+    mutable std::ifstream stream;
+    mutable std::mutex    stream_mutex;
+    // Parts of the arena already read, start to end
+    mutable std::map<Elf64_Off, Elf64_Off> loaded_ranges;
+#ifdef _WIN32
+    HANDLE      mapping;
+#endif
+};
+
+} // namespace ELFIO
+
+#endif // ELFIO_IMAGE_HPP
@@ -25,6 +25,8 @@ THE SOFTWARE.
 
 #include <string>
 #include <iostream>
+#include <atomic>
+#include <mutex>
 
 namespace ELFIO {
 
@@ -58,6 +60,8 @@ class section
     
     virtual void load( std::istream&  f,
                        std::streampos header_offset ) = 0;
+    virtual void load( const elf_image& image,
+                       Elf64_Off        header_offset ) = 0;
     virtual void save( std::ostream&  f,
                        std::streampos header_offset,
                        std::streampos data_offset )   = 0;
@@ -76,12 +80,14 @@ class section_impl : public section
         is_address_set = false;
         data           = 0;
         data_size      = 0;
+        is_data_view   = false;
+        image          = 0;
     }
 
 //------------------------------------------------------------------------------
     ~section_impl()
     {
-        delete [] data;
+        release_data();
     }
 
 //------------------------------------------------------------------------------
@@ -135,9 +141,32 @@ class section_impl : public section
     }
 
 //------------------------------------------------------------------------------
+    // Sections loaded from an elf_image fetch their contents on the first
+    // call. That first call is serialized, so a loaded section may be read
+    // from several threads at once. set_data() and append_data() are not
+    // synchronized and must not race with readers.
     const char*
     get_data() const
     {
+        if ( 0 != image.load( std::memory_order_acquire ) ) {
+            std::lock_guard<std::mutex> lock( load_mutex );
+            const elf_image* pending = image.load( std::memory_order_relaxed );
+            if ( 0 != pending ) {
+                // First access of a lazily loaded section
+                if ( SHT_NULL != get_type() && SHT_NOBITS != get_type() &&
+                     0 != get_size() ) {
+                    data = const_cast<char*>(
+                        pending->get_range( (*convertor)( header.sh_offset ),
+                                            get_size() ) );
+                    if ( 0 != data ) {
+                        data_size    = (Elf_Word)get_size();
+                        is_data_view = true;
+                    }
+                }
+                image.store( 0, std::memory_order_release );
+            }
+        }
+
         return data;
     }
 
@@ -146,7 +175,8 @@ class section_impl : public section
     set_data( const char* raw_data, Elf_Word size )
     {
         if ( get_type() != SHT_NOBITS ) {
-            delete [] data;
+            release_data();
+            image = 0;
             try {
                 data = new char[size];
             } catch (const std::bad_alloc&) {
@@ -175,7 +205,9 @@ class section_impl : public section
     append_data( const char* raw_data, Elf_Word size )
     {
         if ( get_type() != SHT_NOBITS ) {
-            if ( get_size() + size < data_size ) {
+            // Make sure existing lazily loaded contents are kept
+            get_data();
+            if ( !is_data_view && get_size() + size < data_size ) {
                 std::copy( raw_data, raw_data + size, data + get_size() );
             }
             else {
@@ -190,7 +222,7 @@ class section_impl : public section
                 if ( 0 != new_data ) {
                     std::copy( data, data + get_size(), new_data );
                     std::copy( raw_data, raw_data + size, new_data + get_size() );
-                    delete [] data;
+                    release_data();
                     data = new_data;
                 }
             }
@@ -242,6 +274,23 @@ class section_impl : public section
         }
     }
 
+//------------------------------------------------------------------------------
+    void
+    load( const elf_image& image_,
+          Elf64_Off        header_offset )
+    {
+        std::fill_n( reinterpret_cast<char*>( &header ), sizeof( header ), '\0' );
+        const char* p = image_.get_range( header_offset, sizeof( header ) );
+        if ( 0 != p ) {
+            std::copy( p, p + sizeof( header ), reinterpret_cast<char*>( &header ) );
+        }
+
+        // Contents are only pulled from the image on the first get_data()
+        if ( 0 == data ) {
+            image = &image_;
+        }
+    }
+
 //------------------------------------------------------------------------------
     void
     save( std::ostream&  f,
@@ -255,13 +304,24 @@ class section_impl : public section
 
         save_header( f, header_offset );
         if ( get_type() != SHT_NOBITS && get_type() != SHT_NULL &&
-             get_size() != 0 && data != 0 ) {
+             get_size() != 0 && get_data() != 0 ) {
             save_data( f, data_offset );
         }
     }
 
 //------------------------------------------------------------------------------
   private:
+//------------------------------------------------------------------------------
+    void
+    release_data()
+    {
+        if ( !is_data_view ) {
+            delete [] data;
+        }
+        data         = 0;
+        is_data_view = false;
+    }
+
 //------------------------------------------------------------------------------
     void
     save_header( std::ostream&  f,
@@ -285,10 +345,13 @@ class section_impl : public section
     T                          header;
     Elf_Half                   index;
     std::string                name;
-    char*                      data;
-    Elf_Word                   data_size;
+    mutable char*              data;
+    mutable Elf_Word           data_size;
     const endianess_convertor* convertor;
     bool                       is_address_set;
+    mutable bool               is_data_view;
+    mutable std::atomic<const elf_image*> image;
+    mutable std::mutex         load_mutex;
 };
 
 } // namespace ELFIO
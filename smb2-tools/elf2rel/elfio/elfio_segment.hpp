@@ -25,6 +25,8 @@ THE SOFTWARE.
 
 #include <iostream>
 #include <vector>
+#include <atomic>
+#include <mutex>
 
 namespace ELFIO {
 
@@ -57,6 +59,7 @@ class segment
     
     virtual const std::vector<Elf_Half>& get_sections() const               = 0;
     virtual void load( std::istream& stream, std::streampos header_offset ) = 0;
+    virtual void load( const elf_image& image, Elf64_Off header_offset )    = 0;
     virtual void save( std::ostream& f,      std::streampos header_offset,
                                              std::streampos data_offset )   = 0;
 };
@@ -74,12 +77,16 @@ class segment_impl : public segment
         is_offset_set = false;
         std::fill_n( reinterpret_cast<char*>( &ph ), sizeof( ph ), '\0' );
         data = 0;
+        is_data_view = false;
+        image = 0;
     }
 
 //------------------------------------------------------------------------------
     virtual ~segment_impl()
     {
-        delete [] data;
+        if ( !is_data_view ) {
+            delete [] data;
+        }
     }
 
 //------------------------------------------------------------------------------
@@ -104,6 +111,17 @@ class segment_impl : public segment
     const char*
     get_data() const
     {
+        if ( 0 != image.load( std::memory_order_acquire ) ) {
+            // First access of a lazily loaded segment, serialized like sections
+            std::lock_guard<std::mutex> lock( load_mutex );
+            const elf_image* pending = image.load( std::memory_order_relaxed );
+            if ( 0 != pending ) {
+                data = const_cast<char*>(
+                    pending->get_range( (*convertor)( ph.p_offset ), get_file_size() ) );
+                image.store( 0, std::memory_order_release );
+            }
+        }
+
         return data;
     }
 
@@ -194,6 +212,25 @@ class segment_impl : public segment
         }
     }
 
+//------------------------------------------------------------------------------
+    void
+    load( const elf_image& image_,
+          Elf64_Off        header_offset )
+    {
+        std::fill_n( reinterpret_cast<char*>( &ph ), sizeof( ph ), '\0' );
+        const char* p = image_.get_range( header_offset, sizeof( ph ) );
+        if ( 0 != p ) {
+            std::copy( p, p + sizeof( ph ), reinterpret_cast<char*>( &ph ) );
+        }
+        is_offset_set = true;
+
+        // Contents are only pulled from the image on the first get_data()
+        if ( PT_NULL != get_type() && 0 != get_file_size() ) {
+            image        = &image_;
+            is_data_view = true;
+        }
+    }
+
 //------------------------------------------------------------------------------
     void save( std::ostream&  f,
                std::streampos header_offset,
@@ -209,10 +246,13 @@ class segment_impl : public segment
   private:
     T                     ph;
     Elf_Half              index;
-    char*                 data;
+    mutable char*         data;
     std::vector<Elf_Half> sections;
     endianess_convertor*  convertor;
     bool                  is_offset_set;
+    bool                  is_data_view;
+    mutable std::atomic<const elf_image*> image;
+    mutable std::mutex    load_mutex;
 };
 
 } // namespace ELFIO
@@ -0,0 +1,24 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+// FNV-1a over a symbol name, shared by the symbol tables. T picks the 32 or
+// 64 bit variant.
+template<typename T>
+inline T hashName(std::string_view name)
+{
+	static_assert(std::is_same_v<T, uint32_t> || std::is_same_v<T, uint64_t>, "FNV-1a is 32 or 64 bit");
+	constexpr T cOffsetBasis = sizeof(T) == 4 ? static_cast<T>(2166136261u) : static_cast<T>(14695981039346656037ull);
+	constexpr T cPrime = sizeof(T) == 4 ? static_cast<T>(16777619u) : static_cast<T>(1099511628211ull);
+
+	T hash = cOffsetBasis;
+	for (char c : name)
+	{
+		hash = (hash ^ static_cast<uint8_t>(c)) * cPrime;
+	}
+	return hash;
+}
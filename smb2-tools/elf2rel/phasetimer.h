@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Wall clock timings of the named phases of a run. Phases can be recorded
+// from several threads at once, as batch jobs do, every phase remembers a
+// small per-thread number so they can be told apart later.
+class PhaseTimer
+{
+public:
+	struct Phase
+	{
+		std::string name;
+		std::string detail;
+		int64_t startMicroseconds;
+		int64_t durationMicroseconds;
+		int thread;
+	};
+
+	// Ends its phase when destroyed or finished
+	class Scope
+	{
+	public:
+		Scope(PhaseTimer &timer, size_t index)
+			: mTimer(&timer), mIndex(index)
+		{
+		}
+
+		Scope(Scope &&other)
+			: mTimer(other.mTimer), mIndex(other.mIndex)
+		{
+			other.mTimer = nullptr;
+		}
+
+		~Scope()
+		{
+			finish();
+		}
+
+		// Ends the phase early
+		void finish()
+		{
+			if (mTimer)
+			{
+				mTimer->end(mIndex);
+				mTimer = nullptr;
+			}
+		}
+
+		Scope(const Scope &) = delete;
+		Scope &operator=(const Scope &) = delete;
+		Scope &operator=(Scope &&) = delete;
+
+	private:
+		PhaseTimer *mTimer;
+		size_t mIndex;
+	};
+
+	PhaseTimer()
+		: mOrigin(std::chrono::steady_clock::now())
+	{
+	}
+
+	Scope measure(std::string name, std::string detail = std::string())
+	{
+		int64_t now = getElapsedMicroseconds();
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		mPhases.push_back({ std::move(name), std::move(detail), now, 0, getThreadNumber() });
+		return Scope(*this, mPhases.size() - 1);
+	}
+
+	// Only safe once no phase is being recorded anymore
+	const std::vector<Phase> &getPhases() const
+	{
+		return mPhases;
+	}
+
+	// Phase names in the order they first started, with their durations summed
+	std::vector<std::pair<std::string, int64_t>> getTotals() const
+	{
+		std::vector<std::pair<std::string, int64_t>> totals;
+		for (const auto &phase : mPhases)
+		{
+			auto it = totals.begin();
+			while (it != totals.end() && it->first != phase.name)
+			{
+				++it;
+			}
+			if (it == totals.end())
+			{
+				it = totals.emplace(totals.end(), phase.name, 0);
+			}
+			it->second += phase.durationMicroseconds;
+		}
+		return totals;
+	}
+
+	// Time since the timer was created
+	int64_t getElapsedMicroseconds() const
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - mOrigin).count();
+	}
+
+private:
+
+	void end(size_t index)
+	{
+		int64_t now = getElapsedMicroseconds();
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		mPhases[index].durationMicroseconds = now - mPhases[index].startMicroseconds;
+	}
+
+	// Called with the mutex held
+	int getThreadNumber()
+	{
+		std::thread::id id = std::this_thread::get_id();
+		for (size_t i = 0; i < mThreads.size(); ++i)
+		{
+			if (mThreads[i] == id)
+			{
+				return static_cast<int>(i);
+			}
+		}
+		mThreads.emplace_back(id);
+		return static_cast<int>(mThreads.size() - 1);
+	}
+
+	std::chrono::steady_clock::time_point mOrigin;
+	std::mutex mMutex;
+	std::vector<Phase> mPhases;
+	std::vector<std::thread::id> mThreads;
+};
@@ -0,0 +1,517 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "symboldb.h"
+#include "elf2rel.h"
+#include "namehash.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+
+namespace
+{
+
+const char cMagic[4] = { 'E', '2', 'R', 'S' };
+const uint32_t cFormatVersion = 2;
+const uint32_t cByteOrderMark = 0x01020304;
+const uint32_t cEmptySlot = 0xFFFFFFFF;
+
+// Average number of names per perfect hash bucket
+const uint32_t cNamesPerBucket = 4;
+
+template<typename T>
+void appendRaw(std::vector<char> &buffer, const T &value)
+{
+	const char *bytes = reinterpret_cast<const char *>(&value);
+	buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+template<typename T>
+void patchRaw(std::vector<char> &buffer, size_t offset, const T &value)
+{
+	std::memcpy(buffer.data() + offset, &value, sizeof(T));
+}
+
+}
+
+struct SymbolDatabase::FileHeader
+{
+	char magic[4];
+	uint32_t byteOrderMark;
+	uint32_t version;
+	uint32_t regionCount;
+	uint32_t stringPoolOffset;
+	uint32_t stringPoolSize;
+};
+
+// Regions are sorted by source path
+struct SymbolDatabase::FileRegion
+{
+	uint32_t sourceOffset;
+	uint32_t sourceLength;
+	uint64_t sourceSize;
+	int64_t sourceModifiedTime;
+	uint32_t symbolCount;
+	uint32_t bucketCount;
+	uint32_t seedsOffset;
+	uint32_t slotCount;
+	uint32_t slotsOffset;
+	uint32_t overflowCount;
+	uint32_t overflowOffset;
+	uint32_t padding;
+};
+
+struct SymbolDatabase::FileSlot
+{
+	uint32_t nameOffset; // cEmptySlot if unused
+	uint32_t nameLength;
+	uint32_t address;
+};
+
+void SymbolDatabase::Builder::addRegion(const SourceInfo &source, const SymbolList &symbols)
+{
+	Region region;
+	region.source = source;
+
+	// Later definitions override earlier ones, same as the text parser
+	std::map<std::string_view, uint32_t> uniqueSymbols;
+	for (const auto &symbol : symbols)
+	{
+		uniqueSymbols[symbol.first] = symbol.second;
+	}
+	region.symbols.reserve(uniqueSymbols.size());
+	for (const auto &symbol : uniqueSymbols)
+	{
+		region.symbols.emplace_back(std::string(symbol.first), symbol.second);
+	}
+
+	mRegions.emplace_back(std::move(region));
+}
+
+bool SymbolDatabase::Builder::write(const std::string &filename, std::string &log) const
+{
+	std::vector<const Region *> regions;
+	for (const auto &region : mRegions)
+	{
+		regions.emplace_back(&region);
+	}
+	std::sort(regions.begin(), regions.end(), [](const Region *left, const Region *right)
+	{
+		return left->source.path < right->source.path;
+	});
+
+	// Strings go into one pool at the end, offsets are relative to it
+	std::vector<char> stringPool;
+	auto addString = [&](std::string_view string)
+	{
+		uint32_t offset = static_cast<uint32_t>(stringPool.size());
+		stringPool.insert(stringPool.end(), string.begin(), string.end());
+		return offset;
+	};
+
+	std::vector<char> buffer;
+	buffer.resize(sizeof(FileHeader) + regions.size() * sizeof(FileRegion));
+
+	for (size_t regionIndex = 0; regionIndex < regions.size(); ++regionIndex)
+	{
+		const Region &region = *regions[regionIndex];
+		uint32_t symbolCount = static_cast<uint32_t>(region.symbols.size());
+
+		FileRegion fileRegion = {};
+		fileRegion.sourceOffset = addString(region.source.path);
+		fileRegion.sourceLength = static_cast<uint32_t>(region.source.path.size());
+		fileRegion.sourceSize = region.source.size;
+		fileRegion.sourceModifiedTime = region.source.modifiedTime;
+		fileRegion.symbolCount = symbolCount;
+
+		std::vector<uint64_t> hashes(symbolCount);
+		for (uint32_t i = 0; i < symbolCount; ++i)
+		{
+			hashes[i] = hashName<uint64_t>(region.symbols[i].first);
+		}
+
+		// Names with the same hash always land in the same slot, no seed
+		// can ever separate them. The first one of them gets the slot, the
+		// others go into an overflow list that lookups fall back to.
+		std::vector<uint32_t> byHash(symbolCount);
+		for (uint32_t i = 0; i < symbolCount; ++i)
+		{
+			byHash[i] = i;
+		}
+		std::sort(byHash.begin(), byHash.end(), [&](uint32_t left, uint32_t right)
+		{
+			return hashes[left] != hashes[right] ? hashes[left] < hashes[right] : left < right;
+		});
+		std::vector<uint32_t> hashed;
+		std::vector<uint32_t> overflow;
+		for (uint32_t i = 0; i < symbolCount; ++i)
+		{
+			if (i != 0 && hashes[byHash[i - 1]] == hashes[byHash[i]])
+			{
+				overflow.emplace_back(byHash[i]);
+			}
+			else
+			{
+				hashed.emplace_back(byHash[i]);
+			}
+		}
+		uint32_t hashedCount = static_cast<uint32_t>(hashed.size());
+
+		// Hash and displace: names are split into buckets by the upper half
+		// of their hash, then every bucket, biggest first, searches for a seed
+		// that moves all of its names into free slots. A little slack in the
+		// slot count keeps the search short. Should a bucket ever run out of
+		// seeds, start over with more slack, up to twice as many slots as
+		// names.
+		std::vector<uint32_t> seeds;
+		std::vector<uint32_t> slotOwners;
+		bool failed = true;
+		for (uint32_t slackDivisor = 8; failed; slackDivisor /= 2)
+		{
+			uint32_t bucketCount = std::max<uint32_t>((hashedCount + cNamesPerBucket - 1) / cNamesPerBucket, 1);
+			uint32_t slotCount = std::max<uint32_t>(hashedCount + hashedCount / slackDivisor, 1);
+
+			std::vector<std::vector<uint32_t>> buckets(bucketCount);
+			for (uint32_t i : hashed)
+			{
+				buckets[(hashes[i] >> 32) % bucketCount].emplace_back(i);
+			}
+			std::vector<uint32_t> bucketOrder(bucketCount);
+			for (uint32_t i = 0; i < bucketCount; ++i)
+			{
+				bucketOrder[i] = i;
+			}
+			std::stable_sort(bucketOrder.begin(), bucketOrder.end(), [&](uint32_t left, uint32_t right)
+			{
+				return buckets[left].size() > buckets[right].size();
+			});
+
+			seeds.assign(bucketCount, 0);
+			slotOwners.assign(slotCount, cEmptySlot);
+			failed = false;
+			std::vector<uint32_t> bucketSlots;
+			for (uint32_t bucketIndex : bucketOrder)
+			{
+				const std::vector<uint32_t> &bucket = buckets[bucketIndex];
+				if (bucket.empty())
+				{
+					break;
+				}
+
+				bool placed = false;
+				for (uint32_t seed = 0; seed < 0x100000 && !placed; ++seed)
+				{
+					bucketSlots.clear();
+					placed = true;
+					for (uint32_t symbolIndex : bucket)
+					{
+						uint32_t slot = getSlot(hashes[symbolIndex], seed, slotCount);
+						if (slotOwners[slot] != cEmptySlot
+							|| std::find(bucketSlots.begin(), bucketSlots.end(), slot) != bucketSlots.end())
+						{
+							placed = false;
+							break;
+						}
+						bucketSlots.emplace_back(slot);
+					}
+
+					if (placed)
+					{
+						for (size_t i = 0; i < bucket.size(); ++i)
+						{
+							slotOwners[bucketSlots[i]] = bucket[i];
+						}
+						seeds[bucketIndex] = seed;
+					}
+				}
+
+				if (!placed)
+				{
+					failed = true;
+					break;
+				}
+			}
+
+			if (!failed)
+			{
+				fileRegion.bucketCount = bucketCount;
+				fileRegion.slotCount = slotCount;
+			}
+			else if (slackDivisor == 1)
+			{
+				appendFormat(log, "%s: No perfect hash found for %u symbols\n", region.source.path.c_str(), symbolCount);
+				return false;
+			}
+		}
+
+		fileRegion.seedsOffset = static_cast<uint32_t>(buffer.size());
+		for (uint32_t seed : seeds)
+		{
+			appendRaw(buffer, seed);
+		}
+
+		fileRegion.slotsOffset = static_cast<uint32_t>(buffer.size());
+		for (uint32_t owner : slotOwners)
+		{
+			FileSlot slot = { cEmptySlot, 0, 0 };
+			if (owner != cEmptySlot)
+			{
+				const auto &symbol = region.symbols[owner];
+				slot.nameOffset = addString(symbol.first);
+				slot.nameLength = static_cast<uint32_t>(symbol.first.size());
+				slot.address = symbol.second;
+			}
+			appendRaw(buffer, slot);
+		}
+
+		fileRegion.overflowCount = static_cast<uint32_t>(overflow.size());
+		fileRegion.overflowOffset = static_cast<uint32_t>(buffer.size());
+		for (uint32_t owner : overflow)
+		{
+			const auto &symbol = region.symbols[owner];
+			FileSlot slot = { addString(symbol.first), static_cast<uint32_t>(symbol.first.size()), symbol.second };
+			appendRaw(buffer, slot);
+		}
+
+		patchRaw(buffer, sizeof(FileHeader) + regionIndex * sizeof(FileRegion), fileRegion);
+	}
+
+	FileHeader header;
+	std::memcpy(header.magic, cMagic, sizeof(cMagic));
+	header.byteOrderMark = cByteOrderMark;
+	header.version = cFormatVersion;
+	header.regionCount = static_cast<uint32_t>(regions.size());
+	header.stringPoolOffset = static_cast<uint32_t>(buffer.size());
+	header.stringPoolSize = static_cast<uint32_t>(stringPool.size());
+	patchRaw(buffer, 0, header);
+	buffer.insert(buffer.end(), stringPool.begin(), stringPool.end());
+
+	// Write to a temporary file first and move it into place, so concurrent
+	// runs never see a partially written database
+	std::random_device random;
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%08x.tmp", static_cast<uint32_t>(random()));
+	std::string temporaryFilename = filename + suffix;
+	{
+		std::ofstream outputStream(temporaryFilename, std::ios::binary);
+		outputStream.write(buffer.data(), buffer.size());
+		if (!outputStream.good())
+		{
+			outputStream.close();
+			std::remove(temporaryFilename.c_str());
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temporaryFilename, filename, error);
+	if (error)
+	{
+		std::remove(temporaryFilename.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool SymbolDatabase::open(const std::string &filename)
+{
+	close();
+
+	if (!mImage.open(filename))
+	{
+		return false;
+	}
+
+	mData = mImage.get_range(0, mImage.get_size());
+	mSize = static_cast<size_t>(mImage.get_size());
+	const FileHeader *header = getHeader();
+	if (!mData
+		|| mSize < sizeof(FileHeader)
+		|| std::memcmp(header->magic, cMagic, sizeof(cMagic)) != 0
+		|| header->byteOrderMark != cByteOrderMark
+		|| header->version != cFormatVersion
+		|| header->regionCount > (mSize - sizeof(FileHeader)) / sizeof(FileRegion)
+		|| header->stringPoolOffset > mSize
+		|| header->stringPoolSize > mSize - header->stringPoolOffset)
+	{
+		close();
+		return false;
+	}
+
+	// Only the tables are checked here, names are bounds checked on lookup
+	for (int i = 0; i < getRegionCount(); ++i)
+	{
+		const FileRegion *region = getRegion(i);
+		if (region->bucketCount == 0
+			|| region->slotCount == 0
+			|| region->seedsOffset > mSize
+			|| region->bucketCount > (mSize - region->seedsOffset) / sizeof(uint32_t)
+			|| region->slotsOffset > mSize
+			|| region->slotCount > (mSize - region->slotsOffset) / sizeof(FileSlot)
+			|| region->overflowOffset > mSize
+			|| region->overflowCount > (mSize - region->overflowOffset) / sizeof(FileSlot)
+			|| region->seedsOffset % alignof(uint32_t) != 0
+			|| region->slotsOffset % alignof(FileSlot) != 0
+			|| region->overflowOffset % alignof(FileSlot) != 0)
+		{
+			close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void SymbolDatabase::close()
+{
+	mImage.close();
+	mData = nullptr;
+	mSize = 0;
+}
+
+int SymbolDatabase::getRegionCount() const
+{
+	return mData ? static_cast<int>(getHeader()->regionCount) : 0;
+}
+
+std::string_view SymbolDatabase::getRegionSource(int region) const
+{
+	const FileRegion *fileRegion = getRegion(region);
+	return getString(fileRegion->sourceOffset, fileRegion->sourceLength);
+}
+
+int SymbolDatabase::findRegion(std::string_view sourcePath) const
+{
+	int low = 0;
+	int high = getRegionCount();
+	while (low < high)
+	{
+		int middle = (low + high) / 2;
+		if (getRegionSource(middle) < sourcePath)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	if (low < getRegionCount() && getRegionSource(low) == sourcePath)
+	{
+		return low;
+	}
+	return cInvalidRegion;
+}
+
+bool SymbolDatabase::isRegionCurrent(int region) const
+{
+	const FileRegion *fileRegion = getRegion(region);
+
+	SourceInfo info;
+	return getSourceInfo(std::string(getRegionSource(region)), info)
+		&& info.size == fileRegion->sourceSize
+		&& info.modifiedTime == fileRegion->sourceModifiedTime;
+}
+
+bool SymbolDatabase::find(int region, std::string_view name, uint32_t &address) const
+{
+	const FileRegion *fileRegion = getRegion(region);
+	if (fileRegion->symbolCount == 0)
+	{
+		return false;
+	}
+
+	uint64_t hash = hashName<uint64_t>(name);
+	uint32_t seed;
+	std::memcpy(&seed,
+				mData + fileRegion->seedsOffset + ((hash >> 32) % fileRegion->bucketCount) * sizeof(uint32_t),
+				sizeof(seed));
+
+	const FileSlot &slot = reinterpret_cast<const FileSlot *>(mData + fileRegion->slotsOffset)[getSlot(hash, seed, fileRegion->slotCount)];
+	if (slot.nameOffset != cEmptySlot && slot.nameLength == name.size() && getString(slot.nameOffset, slot.nameLength) == name)
+	{
+		address = slot.address;
+		return true;
+	}
+
+	// Names that share their hash with another one, almost always none
+	const FileSlot *overflow = reinterpret_cast<const FileSlot *>(mData + fileRegion->overflowOffset);
+	for (uint32_t i = 0; i < fileRegion->overflowCount; ++i)
+	{
+		if (overflow[i].nameLength == name.size() && getString(overflow[i].nameOffset, overflow[i].nameLength) == name)
+		{
+			address = overflow[i].address;
+			return true;
+		}
+	}
+	return false;
+}
+
+std::string SymbolDatabase::normalizePath(const std::string &path)
+{
+	std::error_code error;
+	std::filesystem::path absolutePath = std::filesystem::absolute(path, error);
+	if (error)
+	{
+		return path;
+	}
+	return absolutePath.lexically_normal().generic_string();
+}
+
+bool SymbolDatabase::getSourceInfo(const std::string &path, SourceInfo &info)
+{
+	std::error_code error;
+	uint64_t size = std::filesystem::file_size(path, error);
+	if (error)
+	{
+		return false;
+	}
+	auto modifiedTime = std::filesystem::last_write_time(path, error);
+	if (error)
+	{
+		return false;
+	}
+
+	info.path = path;
+	info.size = size;
+	info.modifiedTime = static_cast<int64_t>(modifiedTime.time_since_epoch().count());
+	return true;
+}
+
+const SymbolDatabase::FileHeader *SymbolDatabase::getHeader() const
+{
+	return reinterpret_cast<const FileHeader *>(mData);
+}
+
+const SymbolDatabase::FileRegion *SymbolDatabase::getRegion(int region) const
+{
+	return reinterpret_cast<const FileRegion *>(mData + sizeof(FileHeader)) + region;
+}
+
+std::string_view SymbolDatabase::getString(uint32_t offset, uint32_t length) const
+{
+	const FileHeader *header = getHeader();
+	if (offset > header->stringPoolSize || length > header->stringPoolSize - offset)
+	{
+		return std::string_view();
+	}
+	return std::string_view(mData + header->stringPoolOffset + offset, length);
+}
+
+uint32_t SymbolDatabase::getSlot(uint64_t hash, uint32_t seed, uint32_t slotCount)
+{
+	// Murmur3 finalizer over the lower half of the name hash, the upper half
+	// already picked the bucket. Offset by the bucket's seed.
+	uint32_t value = static_cast<uint32_t>(hash) + seed * 0x9E3779B9u;
+	value ^= value >> 16;
+	value *= 0x85EBCA6Bu;
+	value ^= value >> 13;
+	value *= 0xC2B2AE35u;
+	value ^= value >> 16;
+	return value % slotCount;
+}
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <elfio/elfio.hpp>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Precompiled form of one or more .lst symbol maps (one region per map).
+// The file is memory mapped and used as is: every region has a perfect hash
+// over its names, so a lookup is one string hash and a single slot compare.
+// Each region remembers the size and timestamp of the .lst it was built
+// from, which is how stale databases are detected.
+//
+// The file is written in host byte order, it is a build cache and not meant
+// to be shared between machines.
+class SymbolDatabase
+{
+public:
+	struct SourceInfo
+	{
+		std::string path;
+		uint64_t size = 0;
+		int64_t modifiedTime = 0;
+	};
+
+	using SymbolList = std::vector<std::pair<std::string, uint32_t>>;
+
+	// Collects regions and writes them out as a database
+	class Builder
+	{
+	public:
+		void addRegion(const SourceInfo &source, const SymbolList &symbols);
+		bool write(const std::string &filename, std::string &log) const;
+
+	private:
+		struct Region
+		{
+			SourceInfo source;
+			SymbolList symbols;
+		};
+		std::vector<Region> mRegions;
+	};
+
+	static constexpr int cInvalidRegion = -1;
+
+	bool open(const std::string &filename);
+	void close();
+
+	int getRegionCount() const;
+	std::string_view getRegionSource(int region) const;
+	// Region built from the given (normalized) .lst path, or cInvalidRegion
+	int findRegion(std::string_view sourcePath) const;
+	// True if the region's .lst still has the size and timestamp it was built from
+	bool isRegionCurrent(int region) const;
+
+	bool find(int region, std::string_view name, uint32_t &address) const;
+
+	// Absolute, normalized form of a path as used for region sources
+	static std::string normalizePath(const std::string &path);
+	static bool getSourceInfo(const std::string &path, SourceInfo &info);
+
+private:
+	struct FileHeader;
+	struct FileRegion;
+	struct FileSlot;
+
+	const FileHeader *getHeader() const;
+	const FileRegion *getRegion(int region) const;
+	std::string_view getString(uint32_t offset, uint32_t length) const;
+
+	static uint32_t getSlot(uint64_t hash, uint32_t seed, uint32_t slotCount);
+
+	ELFIO::elf_image mImage;
+	const char *mData = nullptr;
+	size_t mSize = 0;
+};
@@ -0,0 +1,133 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "symbolindex.h"
+#include "namehash.h"
+
+#include <cstring>
+
+SymbolIndex::SymbolIndex(const ELFIO::elfio &elf, const ELFIO::section *symbolSection)
+{
+	if (!symbolSection)
+	{
+		return;
+	}
+
+	const ELFIO::section *stringSection = elf.sections[symbolSection->get_link()];
+	if (stringSection && stringSection->get_data())
+	{
+		mStringTable = stringSection->get_data();
+		mStringTableSize = static_cast<uint32_t>(stringSection->get_size());
+	}
+
+	if (elf.get_class() == ELFCLASS32)
+	{
+		decode<ELFIO::Elf32_Sym>(elf, symbolSection);
+	}
+	else
+	{
+		decode<ELFIO::Elf64_Sym>(elf, symbolSection);
+	}
+
+	buildHashTable();
+}
+
+std::string_view SymbolIndex::getName(uint32_t index) const
+{
+	uint32_t nameOffset = mNameOffsets[index];
+	if (nameOffset >= mStringTableSize)
+	{
+		return std::string_view();
+	}
+
+	// Bound the name by the end of the string table in case it is malformed
+	const char *name = mStringTable + nameOffset;
+	const void *end = std::memchr(name, '\0', mStringTableSize - nameOffset);
+	size_t length = end ? static_cast<const char *>(end) - name : mStringTableSize - nameOffset;
+	return std::string_view(name, length);
+}
+
+uint32_t SymbolIndex::find(std::string_view name) const
+{
+	if (mHashTable.empty())
+	{
+		return cInvalidIndex;
+	}
+
+	for (uint32_t slot = hashName<uint32_t>(name) & mHashMask; ; slot = (slot + 1) & mHashMask)
+	{
+		uint32_t entry = mHashTable[slot];
+		if (entry == 0)
+		{
+			return cInvalidIndex;
+		}
+		if (getName(entry - 1) == name)
+		{
+			return entry - 1;
+		}
+	}
+}
+
+template<typename T>
+void SymbolIndex::decode(const ELFIO::elfio &elf, const ELFIO::section *symbolSection)
+{
+	ELFIO::Elf_Xword entrySize = symbolSection->get_entry_size();
+	const char *data = symbolSection->get_data();
+	if (entrySize < sizeof(T) || !data)
+	{
+		return;
+	}
+
+	uint32_t count = static_cast<uint32_t>(symbolSection->get_size() / entrySize);
+	mNameOffsets.resize(count);
+	mValues.resize(count);
+	mSectionIndices.resize(count);
+	mBinds.resize(count);
+
+	const ELFIO::endianess_convertor &convertor = elf.get_convertor();
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		T symbol;
+		std::memcpy(&symbol, data + i * entrySize, sizeof(symbol));
+
+		mNameOffsets[i] = convertor(symbol.st_name);
+		mValues[i] = static_cast<uint32_t>(convertor(symbol.st_value));
+		mSectionIndices[i] = convertor(symbol.st_shndx);
+		mBinds[i] = ELF_ST_BIND(symbol.st_info);
+	}
+}
+
+void SymbolIndex::buildHashTable()
+{
+	// Keep the load factor at or below 50%
+	uint32_t tableSize = 16;
+	while (tableSize < size() * 2)
+	{
+		tableSize *= 2;
+	}
+	mHashTable.assign(tableSize, 0);
+	mHashMask = tableSize - 1;
+
+	for (uint32_t i = 0; i < size(); ++i)
+	{
+		std::string_view name = getName(i);
+		if (name.empty())
+		{
+			continue;
+		}
+
+		// First definition wins, matching a linear scan of the table
+		for (uint32_t slot = hashName<uint32_t>(name) & mHashMask; ; slot = (slot + 1) & mHashMask)
+		{
+			uint32_t entry = mHashTable[slot];
+			if (entry == 0)
+			{
+				mHashTable[slot] = i + 1;
+				break;
+			}
+			if (getName(entry - 1) == name)
+			{
+				break;
+			}
+		}
+	}
+}
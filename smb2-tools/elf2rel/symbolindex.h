@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <elfio/elfio.hpp>
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Decoded view of an ELF symbol table. Every symbol is converted to host
+// endianness once up front and stored in parallel arrays, so lookups by
+// index or by name don't allocate or touch the raw ELF data again.
+class SymbolIndex
+{
+public:
+	static constexpr uint32_t cInvalidIndex = 0xFFFFFFFF;
+
+	SymbolIndex(const ELFIO::elfio &elf, const ELFIO::section *symbolSection);
+
+	uint32_t size() const { return static_cast<uint32_t>(mValues.size()); }
+
+	std::string_view getName(uint32_t index) const;
+	uint32_t getValue(uint32_t index) const { return mValues[index]; }
+	uint16_t getSectionIndex(uint32_t index) const { return mSectionIndices[index]; }
+	uint8_t getBind(uint32_t index) const { return mBinds[index]; }
+
+	// Returns the first symbol with the given name, or cInvalidIndex
+	uint32_t find(std::string_view name) const;
+
+private:
+	template<typename T>
+	void decode(const ELFIO::elfio &elf, const ELFIO::section *symbolSection);
+	void buildHashTable();
+
+	const char *mStringTable = nullptr;
+	uint32_t mStringTableSize = 0;
+
+	std::vector<uint32_t> mNameOffsets;
+	std::vector<uint32_t> mValues;
+	std::vector<uint16_t> mSectionIndices;
+	std::vector<uint8_t> mBinds;
+
+	// Open addressing, power of two sized, holds symbol index + 1 (0 = empty)
+	std::vector<uint32_t> mHashTable;
+	uint32_t mHashMask = 0;
+};
@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "symbolmap.h"
+#include "elf2rel.h"
+#include "namehash.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+
+bool isSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+int getHexDigitValue(char c)
+{
+	if (c >= '0' && c <= '9')
+	{
+		return c - '0';
+	}
+	if (c >= 'a' && c <= 'f')
+	{
+		return c - 'a' + 10;
+	}
+	if (c >= 'A' && c <= 'F')
+	{
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+// memchr is vectorized in every C library we build against, which makes it
+// the fastest portable way to find line ends and separators
+const char *findChar(const char *start, const char *end, char c)
+{
+	const void *found = std::memchr(start, c, end - start);
+	return found ? static_cast<const char *>(found) : end;
+}
+
+}
+
+bool SymbolMap::load(const std::string &filename, std::string &log)
+{
+	mImage.close();
+	mText = nullptr;
+	mTextSize = 0;
+	mEntries.clear();
+	mHashTable.clear();
+	mHashMask = 0;
+
+	if (!mImage.open(filename))
+	{
+		// The image refuses empty files, those are still a valid empty map
+		std::ifstream inputStream(filename, std::ios::binary);
+		return inputStream && inputStream.peek() == std::ifstream::traits_type::eof();
+	}
+
+	mText = mImage.get_range(0, mImage.get_size());
+	if (!mText)
+	{
+		mImage.close();
+		return false;
+	}
+	mTextSize = static_cast<size_t>(mImage.get_size());
+
+	parse(filename, log);
+	return true;
+}
+
+std::string_view SymbolMap::getName(uint32_t index) const
+{
+	const Entry &entry = mEntries[index];
+	return std::string_view(mText + entry.nameOffset, entry.nameLength);
+}
+
+bool SymbolMap::find(std::string_view name, uint32_t &address) const
+{
+	uint32_t section;
+	return find(name, address, section);
+}
+
+bool SymbolMap::find(std::string_view name, uint32_t &address, uint32_t &section) const
+{
+	if (mHashTable.empty())
+	{
+		return false;
+	}
+
+	for (uint32_t slot = hashName<uint32_t>(name) & mHashMask; ; slot = (slot + 1) & mHashMask)
+	{
+		uint32_t entry = mHashTable[slot];
+		if (entry == 0)
+		{
+			return false;
+		}
+		if (getName(entry - 1) == name)
+		{
+			address = mEntries[entry - 1].address;
+			section = mEntries[entry - 1].section;
+			return true;
+		}
+	}
+}
+
+void SymbolMap::parse(const std::string &filename, std::string &log)
+{
+	const char *text = mText;
+	const char *end = text + mTextSize;
+
+	// Size everything for one symbol per line up front, keeping the table's
+	// load factor at or below 50%
+	size_t lineCount = 1;
+	for (const char *c = findChar(text, end, '\n'); c != end; c = findChar(c + 1, end, '\n'))
+	{
+		++lineCount;
+	}
+	mEntries.reserve(lineCount);
+
+	uint32_t tableSize = 16;
+	while (tableSize < lineCount * 2)
+	{
+		tableSize *= 2;
+	}
+	mHashTable.assign(tableSize, 0);
+	mHashMask = tableSize - 1;
+
+	uint32_t lineNumber = 0;
+	for (const char *lineStart = text; lineStart < end; )
+	{
+		++lineNumber;
+		const char *lineEnd = findChar(lineStart, end, '\n');
+		const char *c = lineStart;
+		lineStart = lineEnd + 1;
+
+		while (c < lineEnd && isSpace(*c))
+		{
+			++c;
+		}
+
+		// Ignore comments
+		if (c == lineEnd || *c == '/')
+		{
+			continue;
+		}
+
+		const char *separator = findChar(c, lineEnd, ':');
+		if (separator == lineEnd)
+		{
+			appendFormat(log, "%s:%u: Expected '<address>:<name>'\n", filename.c_str(), lineNumber);
+			continue;
+		}
+
+		uint32_t section = 0;
+		const char *sectionEnd = findChar(c, separator, ',');
+		if (sectionEnd != separator)
+		{
+			for (; c < sectionEnd && *c >= '0' && *c <= '9'; ++c)
+			{
+				section = section * 10 + (*c - '0');
+			}
+			c = sectionEnd + 1;
+		}
+
+		if (separator - c > 2 && c[0] == '0' && (c[1] == 'x' || c[1] == 'X'))
+		{
+			c += 2;
+		}
+		uint32_t address = 0;
+		for (int digit; c < separator && (digit = getHexDigitValue(*c)) >= 0; ++c)
+		{
+			address = (address << 4) | digit;
+		}
+
+		const char *nameStart = separator + 1;
+		const char *nameEnd = lineEnd;
+		while (nameStart < nameEnd && isSpace(*nameStart))
+		{
+			++nameStart;
+		}
+		while (nameEnd > nameStart && isSpace(nameEnd[-1]))
+		{
+			--nameEnd;
+		}
+		if (nameStart == nameEnd)
+		{
+			continue;
+		}
+
+		Entry entry;
+		entry.nameOffset = static_cast<uint32_t>(nameStart - text);
+		entry.nameLength = static_cast<uint32_t>(nameEnd - nameStart);
+		entry.address = address;
+		entry.section = section;
+		entry.line = lineNumber;
+		insert(entry, filename, log);
+	}
+}
+
+void SymbolMap::insert(const Entry &entry, const std::string &filename, std::string &log)
+{
+	std::string_view name(mText + entry.nameOffset, entry.nameLength);
+	for (uint32_t slot = hashName<uint32_t>(name) & mHashMask; ; slot = (slot + 1) & mHashMask)
+	{
+		uint32_t existing = mHashTable[slot];
+		if (existing == 0)
+		{
+			mEntries.emplace_back(entry);
+			mHashTable[slot] = static_cast<uint32_t>(mEntries.size());
+			return;
+		}
+
+		Entry &existingEntry = mEntries[existing - 1];
+		if (getName(existing - 1) == name)
+		{
+			appendFormat(log, "%s:%u: Duplicate symbol '%.*s', previously defined on line %u\n",
+						 filename.c_str(),
+						 entry.line,
+						 static_cast<int>(name.size()), name.data(),
+						 existingEntry.line);
+			existingEntry = entry;
+			return;
+		}
+	}
+}
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <elfio/elfio.hpp>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Symbol map parsed from a text .lst file ("80001234:name" per line, lines
+// starting with / are comments). Maps of game RELs give the section in
+// front of a section relative offset instead ("6,0006FB90:name"). The
+// file is memory mapped where the platform allows it, otherwise read into
+// one buffer, and doubles as the string pool, names are views into it.
+// Lookups go through a flat open addressing table, so neither parsing nor
+// lookups allocate per symbol.
+class SymbolMap
+{
+public:
+	// Returns false if the file can't be read. Duplicate names keep the last
+	// address, like the linker script would, and are reported in log.
+	bool load(const std::string &filename, std::string &log);
+
+	uint32_t size() const { return static_cast<uint32_t>(mEntries.size()); }
+
+	std::string_view getName(uint32_t index) const;
+	uint32_t getAddress(uint32_t index) const { return mEntries[index].address; }
+	uint32_t getSection(uint32_t index) const { return mEntries[index].section; }
+
+	bool find(std::string_view name, uint32_t &address) const;
+	bool find(std::string_view name, uint32_t &address, uint32_t &section) const;
+
+private:
+	struct Entry
+	{
+		uint32_t nameOffset;
+		uint32_t nameLength;
+		uint32_t address;
+		uint32_t section;
+		uint32_t line;
+	};
+
+	void parse(const std::string &filename, std::string &log);
+	void insert(const Entry &entry, const std::string &filename, std::string &log);
+
+	ELFIO::elf_image mImage;
+	const char *mText = nullptr;
+	size_t mTextSize = 0;
+	std::vector<Entry> mEntries;
+
+	// Open addressing, power of two sized, holds entry index + 1 (0 = empty)
+	std::vector<uint32_t> mHashTable;
+	uint32_t mHashMask = 0;
+};
@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Minimal work-stealing pool for running a batch of independent tasks.
+// Task indices are dealt out round-robin into one queue per worker. A worker
+// takes from the front of its own queue and, once that runs dry, steals from
+// the back of the others. Tasks must only write to state owned by their own
+// index so that the results can be merged deterministically afterwards.
+class ThreadPool
+{
+public:
+	explicit ThreadPool(int threadCount)
+		: mThreadCount(std::max(threadCount, 1))
+	{
+	}
+
+	int getThreadCount() const
+	{
+		return mThreadCount;
+	}
+
+	// Calls task(taskIndex, workerIndex) for every index in [0, taskCount)
+	// and returns once all of them have finished. workerIndex is in
+	// [0, getThreadCount()) and can be used to pick per-thread scratch state.
+	template<typename Task>
+	void run(size_t taskCount, Task task)
+	{
+		int workerCount = static_cast<int>(std::min<size_t>(mThreadCount, taskCount));
+		if (workerCount <= 1)
+		{
+			for (size_t i = 0; i < taskCount; ++i)
+			{
+				task(i, 0);
+			}
+			return;
+		}
+
+		std::vector<Queue> queues(workerCount);
+		for (size_t i = 0; i < taskCount; ++i)
+		{
+			queues[i % workerCount].tasks.push_back(i);
+		}
+
+		std::atomic<size_t> remaining(taskCount);
+		auto worker = [&](int workerIndex)
+		{
+			while (remaining.load() > 0)
+			{
+				size_t taskIndex;
+				if (!popOwn(queues[workerIndex], taskIndex) && !steal(queues, workerIndex, taskIndex))
+				{
+					// Everything left is already running on other workers
+					break;
+				}
+
+				task(taskIndex, workerIndex);
+				--remaining;
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (int i = 1; i < workerCount; ++i)
+		{
+			threads.emplace_back(worker, i);
+		}
+		worker(0);
+		for (auto &thread : threads)
+		{
+			thread.join();
+		}
+	}
+
+private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<size_t> tasks;
+	};
+
+	static bool popOwn(Queue &queue, size_t &taskIndex)
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty())
+		{
+			return false;
+		}
+		taskIndex = queue.tasks.front();
+		queue.tasks.pop_front();
+		return true;
+	}
+
+	static bool steal(std::vector<Queue> &queues, int thiefIndex, size_t &taskIndex)
+	{
+		for (size_t i = 1; i < queues.size(); ++i)
+		{
+			Queue &victim = queues[(thiefIndex + i) % queues.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.tasks.empty())
+			{
+				taskIndex = victim.tasks.back();
+				victim.tasks.pop_back();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	int mThreadCount;
+};
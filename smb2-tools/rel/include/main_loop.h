@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+// Symbols in mkb2.main_loop.rel, defined per region in the
+// mkb2.main_loop.<region>.lst maps. elf2rel turns references to them into
+// imports from module 1, which OSLink resolves once when the mod is linked.
+namespace mod::main_loop {
+
+extern "C" {
+
+// Debug mode is on while bits 0 and 1 are set
+extern uint32_t debugFlags;
+
+}
+
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+// Values that differ between regions. They are defined in the smb2.<region>.lst
+// symbol maps rather than here, so one build of the mod links for every region.
+// Only the addresses of these symbols are meaningful.
+namespace mod::region {
+
+extern "C" {
+
+// Offset into mkb2.main_loop.rel of the call the main game loop hook replaces
+extern uint8_t mainLoopHookOffset[];
+
+// OSReport call for ``PERF : event is still open for CPU!``, null in regions
+// that don't have it
+extern uint32_t perfEventReportCall[] __attribute__((weak));
+
+}
+
+}
@@ -2,6 +2,8 @@
 #include "patch.h"
 #include "assembly.h"
 #include "heap.h"
+#include "region.h"
+#include "main_loop.h"
 
 #include <gc/OSModule.h>
 #include <gc/OSAlloc.h>
@@ -34,13 +36,7 @@ bool Mod::performRelPatches(gc::OSModule::OSModuleInfo *newModule, void *bss)
 
 void Mod::performAssemblyPatches()
 {
-#ifdef SMB2_US
-    uint32_t Offset = 0x600;
-#elif defined SMB2_JP
-    uint32_t Offset = 0x604;
-#elif defined SMB2_EU
-    uint32_t Offset = 0x604;
-#endif
+    uint32_t Offset = reinterpret_cast<uint32_t>(region::mainLoopHookOffset);
     // Inject the run function at the start of the main game loop
     patch::writeBranchBL(reinterpret_cast<void *>(reinterpret_cast<uint32_t>(
         heap::HeapData.RelLoaderAddresses.MainLoopRelLocation) + Offset), 
@@ -48,14 +44,16 @@ void Mod::performAssemblyPatches()
     
     /* Remove OSReport call ``PERF : event is still open for CPU!`` 
     since it reports every frame, and thus clutters the console */
-#ifdef SMB2_US
-    // Only needs to be applied to the US version
-    uint32_t *Address = reinterpret_cast<uint32_t *>(0x80033E9C);
-    *Address = 0x60000000; // nop
-    
-    // Clear the cache for the address
-    patch::clear_DC_IC_Cache(Address, sizeof(uint32_t));
-#endif
+    // The call only exists in the US version, the symbol maps of JP and EU
+    // define the weak symbol as 0 so that the patch is skipped there
+    uint32_t *Address = region::perfEventReportCall;
+    if (Address)
+    {
+        *Address = 0x60000000; // nop
+        
+        // Clear the cache for the address
+        patch::clear_DC_IC_Cache(Address, sizeof(uint32_t));
+    }
 }
 
 void checkHeaps()
@@ -116,19 +114,9 @@ void checkHeaps()
 
 void enableDebugMode()
 {
-#ifdef SMB2_US
-    uint32_t Offset = 0x6FB90;
-#elif defined SMB2_JP
-    uint32_t Offset = 0x29898;
-#elif defined SMB2_EU
-    uint32_t Offset = 0x29938;
-#endif
-    
     /* Should check to see if this value ever gets cleared. 
         If not, then the value should only be set once */
-    *reinterpret_cast<uint32_t *>(reinterpret_cast<uint32_t>(
-        heap::HeapData.MainLoopBSSLocation) + Offset) |= 
-        ((1 << 0) | (1 << 1)); // Turn on the 0 and 1 bits
+    main_loop::debugFlags |= ((1 << 0) | (1 << 1)); // Turn on the 0 and 1 bits
 }
 
 void run()